@@ -41,8 +41,10 @@ public:
 
     /**
      * @brief 根据host地址返回所有符合条件的Address
-     * 
-     * @param address 
+     *  数字形式的地址直接解析, 不调用getaddrinfo;
+     *  域名先查缓存, 未命中时在IOManager协程中交给阻塞线程池执行getaddrinfo, 协程挂起而不阻塞工作线程
+     *
+     * @param address
      * @param host 
      * @param family 协议族(AF_INET, AF_INET6, AF_UNIX)
      * @param type sockl 类型 (sock stream, sock dgram)
@@ -76,6 +78,18 @@ public:
 
     static std::shared_ptr<IPAddress> LookupAnyIPAdress(const std::string &host, int family = AF_INET, int type = 0, int protocol = 0);
 
+    /**
+     * @brief 设置域名解析缓存的有效期, getaddrinfo不返回DNS记录的TTL, 统一使用这里的时间
+     *
+     * @param positive_ms 解析成功的结果缓存多少毫秒, 0表示不缓存
+     * @param negative_ms 域名不存在的结果缓存多少毫秒, 0表示不缓存
+     */
+    static void SetLookupCacheTTL(uint64_t positive_ms, uint64_t negative_ms);
+    /**
+     * @brief 清空域名解析缓存
+     */
+    static void ClearLookupCache();
+
     /**
      * @brief 获取本机所有网卡的<网卡名，地址，子网掩码数>
      * 
@@ -1,37 +1,49 @@
 #ifndef __RPC_CHANNEL_H__
 #define __RPC_CHANNEL_H__
 #include "mutex.h"
+#include "utils.h"
 #include <iostream>
+#include <queue>
+#include <vector>
 namespace RPC{
+/**
+ * @brief 有界队列channel
+ *  队列由自旋锁保护, 临界区内不切换协程; 队列满或空时把协程登记到等待队列挂起,
+ *  对方操作后发现有等待者才唤醒. 等待队列也可以被Select登记, 同时等待多个channel
+ */
 template<typename T>
-class ChannelImpl {
+class ChannelImpl : public Noncopyable {
 public:
+    typedef SpinLock MutexType;
     ChannelImpl(size_t capacity):isClosed_(false), capacity_(capacity){
 
     }
 
     bool push(const T &t) {
-        CoMutex::Lock lock(mutex_);
-        if (isClosed_) return false;
-        while (msg_queue_.size() >= capacity_) {
-            pushCv_.wait(lock);
-            if (isClosed_) return false;
+        while (true) {
+            {
+                MutexType::Lock lock(mutex_);
+                if (isClosed_) return false;
+                if (msg_queue_.size() < capacity_) {
+                    msg_queue_.push(t);
+                    lock.unlock();
+                    notifyPop();
+                    return true;
+                }
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            pushWaiters_.add(waiter);
+            // 登记之后重新检查, 期间出队的协程可能没有看到登记
+            if (!canPush()) {
+                waiter->park();
+            } else {
+                waiter->cancel();
+            }
+            pushWaiters_.remove(waiter);
         }
-        msg_queue_.push(t);
-        popCv_.notify();
-        return true;
     }
     bool pop(T &t) {
-        CoMutex::Lock lock(mutex_);
-        if (isClosed_) return false;
-        while (msg_queue_.size() <= 0) {
-            popCv_.wait(lock);
-            if (isClosed_) return false;
-        }
-        t = msg_queue_.front();
-        msg_queue_.pop();
-        pushCv_.notify();
-        return true;
+        return waitForUS((uint64_t)-1, t);
     }
 
     /**
@@ -43,18 +55,152 @@ public:
      * @return false 
      */
     bool waitFor(uint64_t time_ms, T &t) {
-        CoMutex::Lock lock(mutex_);
-        if (isClosed_) return false;
-        while (msg_queue_.empty()) {
-            if (!popCv_.waitFor(lock, time_ms)) return false;
-            if (isClosed_) return false;
+        return waitForUS(time_ms == (uint64_t)-1 ? time_ms : time_ms * 1000, t);
+    }
+
+    /**
+     * @brief 等待time_us微秒， 读取channel数据
+     * 
+     * @param time_us 
+     * @param t 
+     * @return true 
+     * @return false 
+     */
+    bool waitForUS(uint64_t time_us, T &t) {
+        uint64_t deadline = time_us == (uint64_t)-1 ? time_us : GetMonotonicUS() + time_us;
+        while (true) {
+            {
+                MutexType::Lock lock(mutex_);
+                if (isClosed_) return false;
+                if (!msg_queue_.empty()) {
+                    t = msg_queue_.front();
+                    msg_queue_.pop();
+                    lock.unlock();
+                    notifyPush();
+                    return true;
+                }
+            }
+            uint64_t timeout = (uint64_t)-1;
+            if (deadline != (uint64_t)-1) {
+                uint64_t now = GetMonotonicUS();
+                if (now >= deadline) {
+                    return false;
+                }
+                timeout = deadline - now;
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            popWaiters_.add(waiter);
+            bool woken = true;
+            if (!canPop()) {
+                woken = waiter->park(timeout);
+            } else {
+                waiter->cancel();
+            }
+            popWaiters_.remove(waiter);
+            if (!woken) {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * @brief 不挂起的push, 队列满或已关闭时返回false
+     */
+    bool tryPush(const T &t) {
+        MutexType::Lock lock(mutex_);
+        if (isClosed_ || msg_queue_.size() >= capacity_) {
+            return false;
+        }
+        msg_queue_.push(t);
+        lock.unlock();
+        notifyPop();
+        return true;
+    }
+
+    /**
+     * @brief 不挂起的pop, 队列空或已关闭时返回false
+     */
+    bool tryPop(T &t) {
+        MutexType::Lock lock(mutex_);
+        if (isClosed_ || msg_queue_.empty()) {
+            return false;
         }
         t = msg_queue_.front();
         msg_queue_.pop();
-        pushCv_.notify();
+        lock.unlock();
+        notifyPush();
         return true;
     }
 
+    /**
+     * @brief 等到channel不为空, 一次加锁取出最多max个数据追加到items, 只唤醒一轮入队协程
+     * @return 取出的数量, channel关闭时返回0
+     */
+    size_t popBatch(std::vector<T> &items, size_t max = (size_t)-1) {
+        if (max == 0) {
+            return 0;
+        }
+        while (true) {
+            {
+                MutexType::Lock lock(mutex_);
+                if (isClosed_) return 0;
+                size_t n = 0;
+                while (n < max && !msg_queue_.empty()) {
+                    items.push_back(std::move(msg_queue_.front()));
+                    msg_queue_.pop();
+                    ++n;
+                }
+                if (n) {
+                    lock.unlock();
+                    notifyPush(n);
+                    return n;
+                }
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            popWaiters_.add(waiter);
+            if (!canPop()) {
+                waiter->park();
+            } else {
+                waiter->cancel();
+            }
+            popWaiters_.remove(waiter);
+        }
+    }
+
+    /**
+     * @brief 写入items中的所有数据, 每次加锁放入队列能容纳的部分并唤醒一轮出队协程, 队列满时挂起
+     * @return 写入的数量, 小于items.size()表示channel已关闭
+     */
+    size_t pushBatch(const std::vector<T> &items) {
+        size_t pushed = 0;
+        while (pushed < items.size()) {
+            {
+                MutexType::Lock lock(mutex_);
+                if (isClosed_) break;
+                size_t n = 0;
+                while (pushed + n < items.size() && msg_queue_.size() < capacity_) {
+                    msg_queue_.push(items[pushed + n]);
+                    ++n;
+                }
+                if (n) {
+                    lock.unlock();
+                    pushed += n;
+                    notifyPop(n);
+                    continue;
+                }
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            pushWaiters_.add(waiter);
+            if (!canPush()) {
+                waiter->park();
+            } else {
+                waiter->cancel();
+            }
+            pushWaiters_.remove(waiter);
+        }
+        return pushed;
+    }
+
     ChannelImpl& operator <<(const T &t) {
         push(t);
         return *this;
@@ -64,17 +210,20 @@ public:
         return *this;
     }
     operator bool() {
+        MutexType::Lock lock(mutex_);
         return !isClosed_;
     }
     void close() {
-        CoMutex::Lock lock(mutex_);
-        if (isClosed_)
-            return;
-        isClosed_ = true;
-        pushCv_.notifyAll();
-        popCv_.notifyAll();
         std::queue<T> q;
-        swap(msg_queue_, q);
+        {
+            MutexType::Lock lock(mutex_);
+            if (isClosed_)
+                return;
+            isClosed_ = true;
+            swap(msg_queue_, q);
+        }
+        pushWaiters_.notifyAll(&pushWaiters_);
+        popWaiters_.notifyAll(&popWaiters_);
     }
 
     size_t capacity() const {
@@ -82,7 +231,7 @@ public:
     }
 
     size_t size() const {
-        CoMutex::Lock lock(mutex_);
+        MutexType::Lock lock(mutex_);
         return msg_queue_.size();
     }
 
@@ -90,14 +239,43 @@ public:
         return !size();
     }
 
+    /**
+     * @brief 队列满时挂起的入队协程, 出队后唤醒, 唤醒来源是该队列的地址
+     */
+    FiberWaitQueue& getPushWaiters() { return pushWaiters_; }
+    /**
+     * @brief 队列空时挂起的出队协程, 入队后唤醒, 唤醒来源是该队列的地址
+     */
+    FiberWaitQueue& getPopWaiters() { return popWaiters_; }
+
+private:
+    bool canPush() const {
+        MutexType::Lock lock(mutex_);
+        return isClosed_ || msg_queue_.size() < capacity_;
+    }
+    bool canPop() const {
+        MutexType::Lock lock(mutex_);
+        return isClosed_ || !msg_queue_.empty();
+    }
+    void notifyPush(size_t count = 1) {
+        if (pushWaiters_.hasWaiters()) {
+            pushWaiters_.notify(count, &pushWaiters_);
+        }
+    }
+    void notifyPop(size_t count = 1) {
+        if (popWaiters_.hasWaiters()) {
+            popWaiters_.notify(count, &popWaiters_);
+        }
+    }
+
 private:
     bool isClosed_;
     size_t capacity_;
-    CoMutex mutex_;
-    /*入队条件变量*/
-    CoCondVar pushCv_;
-    /*出队条件变量*/
-    CoCondVar popCv_;
+    mutable MutexType mutex_;
+    /*入队等待队列*/
+    FiberWaitQueue pushWaiters_;
+    /*出队等待队列*/
+    FiberWaitQueue popWaiters_;
     /*消息队列*/
     std::queue<T> msg_queue_; 
 };
@@ -117,11 +295,27 @@ public:
     bool pop(T &t) {
         return channel_impl_->pop(t);
     }
+    bool tryPush(const T &t) {
+        return channel_impl_->tryPush(t);
+    }
+    bool tryPop(T &t) {
+        return channel_impl_->tryPop(t);
+    }
+    size_t popBatch(std::vector<T> &items, size_t max = (size_t)-1) {
+        return channel_impl_->popBatch(items, max);
+    }
+    size_t pushBatch(const std::vector<T> &items) {
+        return channel_impl_->pushBatch(items);
+    }
 
     bool waitFor(uint64_t time_ms, T &t) {
         return channel_impl_->waitFor(time_ms, t);
     }
 
+    bool waitForUS(uint64_t time_us, T &t) {
+        return channel_impl_->waitForUS(time_us, t);
+    }
+
     Channel& operator <<(const T &t) {
        push(t);
        return *this; 
@@ -152,6 +346,12 @@ public:
     bool unique() const {
         return channel_impl_.unique();
     }
+    FiberWaitQueue& getPushWaiters() {
+        return channel_impl_->getPushWaiters();
+    }
+    FiberWaitQueue& getPopWaiters() {
+        return channel_impl_->getPopWaiters();
+    }
 private:
     std::shared_ptr<ChannelImpl<T>> channel_impl_;
 
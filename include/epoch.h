@@ -0,0 +1,33 @@
+#ifndef __EPOCH_H__
+#define __EPOCH_H__
+#include "noncopyable.h"
+#include <memory>
+namespace RPC {
+/**
+ * @brief 基于epoch的延迟回收, 全进程共用一个epoch
+ *  读者进入临界区时记录当前的epoch, 只有几次原子读写, 不加锁也不修改引用计数
+ *  写者先把对象从共享结构中摘除再交给Retire, 所有在摘除之前进入临界区的读者离开后才释放
+ *  临界区内不能切换协程, 也不要执行可能长时间阻塞的系统调用, 否则会推迟回收
+ */
+class Epoch {
+public:
+    /**
+     * @brief 进入临界区, 可以嵌套
+     */
+    static void Enter();
+    static void Leave();
+    /**
+     * @brief 延迟释放已经摘除的对象, 释放时机是之后某次Retire调用检查到没有读者还可能持有它
+     */
+    static void Retire(std::shared_ptr<void> obj);
+
+    class Guard : public Noncopyable {
+    public:
+        Guard() { Enter(); }
+        ~Guard() { Leave(); }
+    };
+};
+
+}
+
+#endif
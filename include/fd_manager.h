@@ -2,6 +2,8 @@
 #define __FD_MANAGER_H__
 #include "io_manager.h"
 #include "singleton.h"
+#include "epoch.h"
+#include <atomic>
 #include <memory>
 namespace RPC {
 /**
@@ -9,13 +11,16 @@ namespace RPC {
  * 
  */
 
-class FdContext {
+class FdContext : public std::enable_shared_from_this<FdContext> {
 public:
     typedef std::shared_ptr<FdContext> ptr;
     FdContext(int fd);
     ~FdContext();
     
     bool init();
+    /**
+     * @brief 设置/获取SO_RCVTIMEO或SO_SNDTIMEO对应的超时时间(微秒), -1表示不超时
+     */
     void setTimeout(int type, uint64_t time);
     uint64_t getTimeout(int type);
 
@@ -37,17 +42,48 @@ private:
     uint64_t recvTimeout_;
 };
 
+/**
+ * @brief 按fd下标的两级表, 每块4096个句柄, 块创建后原子发布, 不会移动
+ *  查找不加锁, 只有几次原子读取; 创建和删除由mutex串行化
+ *  删除的上下文交给Epoch延迟释放, Epoch临界区内通过lookup拿到的指针一直有效
+ */
 class FdManager{
 public:
     typedef std::shared_ptr<FdManager> ptr;
-    typedef RWMutex RWMutexType;
+    typedef Mutex MutexType;
     FdManager();
     ~FdManager();
+    /**
+     * @brief 获取fd上下文的引用, 需要跨越协程切换持有时使用
+     */
     FdContext::ptr getFdContext(int fd, bool auto_create = false);
+    /**
+     * @brief 无锁查找, 不增加引用计数, 需要在Epoch::Guard的作用域内调用, 返回的指针只在该作用域内有效
+     */
+    FdContext* lookup(int fd) const {
+        if ((unsigned)fd >= MAX_FDS) {
+            return nullptr;
+        }
+        Chunk *chunk = chunks_[fd >> CHUNK_BITS].load(std::memory_order_acquire);
+        if (!chunk) {
+            return nullptr;
+        }
+        return chunk->contexts[fd & (CHUNK_SIZE - 1)].load(std::memory_order_acquire);
+    }
     void delFdContext(int fd);
 private:
-    std::vector<FdContext::ptr> fdContextList_;
-    RWMutexType mutex_;
+    static const int CHUNK_BITS = 12;
+    static const unsigned CHUNK_SIZE = 1 << CHUNK_BITS;
+    static const unsigned MAX_CHUNKS = 4096;
+    static const unsigned MAX_FDS = CHUNK_SIZE * MAX_CHUNKS;
+    struct Chunk {
+        // 读者看到的指针
+        std::atomic<FdContext *> contexts[CHUNK_SIZE];
+        // 持有上下文的引用, 只在mutex保护下修改
+        FdContext::ptr owners[CHUNK_SIZE];
+    };
+    std::atomic<Chunk *> chunks_[MAX_CHUNKS];
+    MutexType mutex_;
 };
 typedef Singleton<FdManager> FdMgr;
 
@@ -1,7 +1,9 @@
 #ifndef __FIBER_H__
 #define __FIBER_H__
+#include "fiber_context.h"
+#include "fiber_stack.h"
+#include <atomic>
 #include <functional>
-#include <ucontext.h>
 #include <memory>
 namespace RPC {
 class Fiber: public std::enable_shared_from_this<Fiber> {
@@ -21,7 +23,12 @@ public:
     };
 
 
-    Fiber(std::function<void()> func, size_t stack_size = 128 * 1024);
+    /**
+     * @param func 协程执行函数
+     * @param stack_size 独立栈的大小
+     * @param shared_stack 是否使用共享栈模式, 共享栈协程第一次执行后绑定在该线程上
+     */
+    Fiber(std::function<void()> func, size_t stack_size = 128 * 1024, bool shared_stack = false);
     ~Fiber();
 
     /**
@@ -50,6 +57,12 @@ public:
     }
 
     uint64_t GetId() const { return id_;}
+
+    bool isSharedStack() const { return sharedStack_; }
+    /**
+     * @brief 共享栈协程绑定的线程id, 独立栈协程或尚未执行过返回-1
+     */
+    int getBoundThread() const { return thread_; }
 public:
     static Fiber::ptr GetThis();
 
@@ -66,8 +79,20 @@ public:
     static void MainFunc();    
 
     static uint64_t GetFiberId();
+    /**
+     * @brief 共享栈协程切出时保存栈内容占用的内存总量
+     */
+    static uint64_t GetSharedStackSavedBytes();
 private:
     Fiber();
+    /**
+     * @brief 切入共享栈协程前调用, 把共享栈当前的占用者拷贝出去, 再恢复自己的栈内容
+     */
+    void acquireSharedStack();
+    /**
+     * @brief 把共享栈上已使用的部分拷贝到自己的缓冲区
+     */
+    void saveSharedStack();
 
 
 
@@ -75,15 +100,29 @@ private:
     uint64_t id_;
 
     uint32_t stack_size_;
-    // 栈指针
+    // 栈指针(由FiberStackPool分配)
     void *stack_;
 
     State state_;
     // 协程上下文
-    ucontext_t ctx_;
+    FiberContext ctx_;
+    // 从Resume切入到切回Resume期间为true, 状态在切出之前就已经修改,
+    // 其他线程必须等上下文保存完成后才能恢复这个协程
+    std::atomic<bool> running_{false};
 
     std::function<void()> func_;
 
+    // 是否共享栈模式
+    bool sharedStack_;
+    // 共享栈协程绑定的线程
+    int thread_;
+    // 共享栈协程使用的共享栈, 第一次执行时绑定
+    std::shared_ptr<SharedStack> shared_;
+    // 共享栈协程切出时保存的栈内容
+    char *saveBuffer_;
+    size_t saveSize_;
+    size_t saveCapacity_;
+
 
 
 
@@ -0,0 +1,80 @@
+#ifndef __FIBER_CONTEXT_H__
+#define __FIBER_CONTEXT_H__
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * 汇编实现只支持x86-64和aarch64, 其他平台或定义了RPC_FIBER_UCONTEXT时使用ucontext
+ */
+#if !defined(RPC_FIBER_UCONTEXT) && !defined(__x86_64__) && !defined(__aarch64__)
+#define RPC_FIBER_UCONTEXT
+#endif
+
+#ifdef RPC_FIBER_UCONTEXT
+#include <ucontext.h>
+#else
+extern "C" {
+/**
+ * @brief 保存callee-saved寄存器到当前栈, 栈顶写入*from_sp, 然后切换到to_sp指向的栈
+ */
+void rpc_fiber_swap_context(void **from_sp, void *to_sp);
+}
+#endif
+
+namespace RPC {
+/**
+ * @brief 协程上下文
+ *  默认使用汇编实现的上下文切换, 只保存恢复callee-saved寄存器,
+ *  不像swapcontext那样每次切换都调用rt_sigprocmask保存信号屏蔽字
+ */
+class FiberContext {
+public:
+    typedef void (*EntryFunc)();
+
+    /**
+     * @brief 在指定的栈上构造上下文, 切换进来时从entry开始执行, entry不能返回
+     *
+     * @param stack 栈的起始地址(低地址)
+     * @param size 栈大小
+     * @param entry 入口函数
+     */
+    bool make(void *stack, size_t size, EntryFunc entry);
+
+    /**
+     * @brief 保存当前上下文到from, 并切换到to
+     */
+    static bool swap(FiberContext &from, FiberContext &to) {
+#ifdef RPC_FIBER_UCONTEXT
+        return swapcontext(&from.ctx_, &to.ctx_) == 0;
+#else
+        rpc_fiber_swap_context(&from.sp_, to.sp_);
+        return true;
+#endif
+    }
+
+    /**
+     * @brief 上下文切出时保存的栈顶(ucontext实现返回nullptr)
+     */
+    void* getStackPointer() const {
+#ifdef RPC_FIBER_UCONTEXT
+        return nullptr;
+#else
+        return sp_;
+#endif
+    }
+
+    /**
+     * @brief 上下文实现的名称
+     */
+    static const char* Backend();
+private:
+#ifdef RPC_FIBER_UCONTEXT
+    ucontext_t ctx_;
+#else
+    void *sp_ = nullptr;
+#endif
+};
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef __FIBER_STACK_H__
+#define __FIBER_STACK_H__
+#include "noncopyable.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <memory>
+namespace RPC {
+class Fiber;
+/**
+ * @brief 协程栈池
+ *  每个线程一个栈池, 栈通过mmap分配, 低地址处有一个PROT_NONE的守护页, 栈溢出时直接段错误而不是破坏堆
+ *  栈大小按2的幂划分规格(16KiB ~ 1MiB), 每种规格缓存有限个释放的栈,
+ *  超出热缓存数量的栈在放回时madvise(MADV_DONTNEED)归还物理内存
+ */
+class FiberStackPool : public Noncopyable {
+public:
+    /**
+     * @brief 栈池统计信息(所有线程汇总)
+     */
+    struct Stat {
+        uint64_t hits = 0;          // 从缓存中分配的次数
+        uint64_t misses = 0;        // 需要mmap新栈的次数
+        uint64_t inUse = 0;         // 正在被协程使用的栈数量
+        uint64_t cached = 0;        // 缓存中的栈数量
+        uint64_t mappedBytes = 0;   // mmap的栈内存总量(不含守护页)
+        uint64_t residentBytes = 0; // 常驻的栈内存(使用中的栈 + 未madvise的缓存栈)
+    };
+
+    /**
+     * @brief 分配一个协程栈
+     *
+     * @param size 期望的栈大小, 会向上取整到规格大小, 返回时为实际大小
+     * @return void* 栈的低地址, 失败返回nullptr
+     */
+    static void* Alloc(size_t &size);
+    /**
+     * @brief 归还协程栈, 可以在任意线程归还
+     */
+    static void Free(void *stack, size_t size);
+
+    static Stat GetStat();
+
+    ~FiberStackPool();
+private:
+    FiberStackPool() = default;
+    static FiberStackPool* GetThis();
+    /**
+     * @brief 栈大小对应的规格下标, 超出最大规格返回-1
+     */
+    static int SizeClass(size_t size);
+
+    static void* Map(size_t size);
+    static void Unmap(void *stack, size_t size);
+private:
+    struct CacheEntry {
+        void *stack;
+        bool resident; // 是否仍然占用物理内存
+    };
+    static const int kClassCount = 7;
+    std::vector<CacheEntry> cache_[kClassCount];
+};
+
+/**
+ * @brief 线程共享栈
+ *  共享栈模式的协程都在所属线程的共享栈上运行, 协程切出后, 只有在其他协程要使用共享栈时
+ *  才把它已使用的部分拷贝出去, 再次切入前拷贝回来(类似libco的copy stack)
+ */
+class SharedStack : public Noncopyable {
+public:
+    typedef std::shared_ptr<SharedStack> ptr;
+    SharedStack(size_t size);
+    ~SharedStack();
+    /**
+     * @brief 当前线程的共享栈
+     */
+    static SharedStack::ptr GetThis();
+
+    void* getStack() const { return stack_; }
+    size_t getSize() const { return size_; }
+    char* getTop() const { return (char *)stack_ + size_; }
+    /**
+     * @brief 当前栈上保存着哪个协程的内容
+     */
+    Fiber* getOwner() const { return owner_; }
+    void setOwner(Fiber *fiber) { owner_ = fiber; }
+private:
+    void *stack_;
+    size_t size_;
+    Fiber *owner_;
+};
+
+}
+
+#endif
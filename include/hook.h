@@ -1,6 +1,9 @@
 #ifndef __HOOK_H__
 #define __HOOK_H__
 #include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <poll.h>
 #include <stdint.h>
 #include <unistd.h>
 namespace RPC {
@@ -33,7 +36,14 @@ void set_hook_enable(bool flag);
     XX(fcntl) \
     XX(ioctl) \
     XX(getsockopt) \
-    XX(setsockopt)
+    XX(setsockopt) \
+    XX(poll) \
+    XX(select) \
+    XX(epoll_wait) \
+    XX(accept4) \
+    XX(pread) \
+    XX(pwrite) \
+    XX(sendfile)
  * 
  */
 extern "C" {
@@ -108,6 +118,33 @@ typedef int (*setsockopt_fun)(int sockfd, int level, int optname,
                       const void *optval, socklen_t optlen);
 extern setsockopt_fun setsockopt_f;
 
+/**
+ * poll/select/epoll_wait: 句柄的可读可写事件注册到IOManager, 协程挂起直到就绪或超时
+ */
+typedef int (*poll_fun)(struct pollfd *fds, nfds_t nfds, int timeout);
+extern poll_fun poll_f;
+
+typedef int (*select_fun)(int nfds, fd_set *readfds, fd_set *writefds,
+                          fd_set *exceptfds, struct timeval *timeout);
+extern select_fun select_f;
+
+typedef int (*epoll_wait_fun)(int epfd, struct epoll_event *events, int maxevents, int timeout);
+extern epoll_wait_fun epoll_wait_f;
+
+typedef int (*accept4_fun)(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags);
+extern accept4_fun accept4_f;
+
+/**
+ * pread/pwrite: 普通文件不能用epoll等待, 不在页缓存中时交给阻塞线程池执行
+ */
+typedef ssize_t (*pread_fun)(int fd, void *buf, size_t count, off_t offset);
+extern pread_fun pread_f;
+
+typedef ssize_t (*pwrite_fun)(int fd, const void *buf, size_t count, off_t offset);
+extern pwrite_fun pwrite_f;
+
+typedef ssize_t (*sendfile_fun)(int out_fd, int in_fd, off_t *offset, size_t count);
+extern sendfile_fun sendfile_f;
 
 extern int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addrlen, uint64_t timeout);
 }
@@ -0,0 +1,123 @@
+#ifndef __INLINE_FUNCTION_H__
+#define __INLINE_FUNCTION_H__
+#include <stddef.h>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+namespace RPC {
+/**
+ * @brief 只能移动的无参回调, 较小的可调用对象直接存放在内部缓冲区, 不需要分配内存
+ *  缓冲区能放下 std::bind(成员函数, shared_ptr, shared_ptr) 这类常见的任务,
+ *  放不下或移动可能抛异常的对象才在堆上分配
+ */
+class InlineFunction {
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    InlineFunction() : ops_(nullptr) {}
+    InlineFunction(std::nullptr_t) : ops_(nullptr) {}
+
+    template<class F, class Fn = typename std::decay<F>::type,
+             class = typename std::enable_if<!std::is_same<Fn, InlineFunction>::value>::type>
+    InlineFunction(F &&f) : ops_(nullptr) {
+        if (IsNull(f)) {
+            return;
+        }
+        Store<Fn>(std::forward<F>(f), std::integral_constant<bool, IsInline<Fn>()>());
+    }
+
+    InlineFunction(InlineFunction &&other) : ops_(other.ops_) {
+        if (ops_) {
+            ops_->move(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    InlineFunction& operator=(InlineFunction &&other) {
+        if (this != &other) {
+            reset();
+            ops_ = other.ops_;
+            if (ops_) {
+                ops_->move(storage_, other.storage_);
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    InlineFunction& operator=(std::nullptr_t) {
+        reset();
+        return *this;
+    }
+
+    InlineFunction(const InlineFunction &) = delete;
+    InlineFunction& operator=(const InlineFunction &) = delete;
+
+    ~InlineFunction() { reset(); }
+
+    void operator()() { ops_->invoke(storage_); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    void reset() {
+        if (ops_) {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+private:
+    struct Ops {
+        void (*invoke)(void *data);
+        // 把src中的对象移动到dst, 并销毁src中的对象
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *data);
+    };
+
+    template<class Fn>
+    static constexpr bool IsInline() {
+        return sizeof(Fn) <= INLINE_SIZE
+            && alignof(Fn) <= alignof(::max_align_t)
+            && std::is_nothrow_move_constructible<Fn>::value;
+    }
+
+    template<class Fn>
+    static bool IsNull(const Fn &) { return false; }
+    static bool IsNull(const std::function<void()> &f) { return !f; }
+    template<class R>
+    static bool IsNull(R (*f)()) { return f == nullptr; }
+
+    template<class Fn, class F>
+    void Store(F &&f, std::true_type) {
+        static const Ops s_ops = {
+            [](void *data) { (*static_cast<Fn *>(data))(); },
+            [](void *dst, void *src) {
+                Fn *from = static_cast<Fn *>(src);
+                new (dst) Fn(std::move(*from));
+                from->~Fn();
+            },
+            [](void *data) { static_cast<Fn *>(data)->~Fn(); }
+        };
+        new (storage_) Fn(std::forward<F>(f));
+        ops_ = &s_ops;
+    }
+
+    template<class Fn, class F>
+    void Store(F &&f, std::false_type) {
+        static const Ops s_ops = {
+            [](void *data) { (**static_cast<Fn **>(data))(); },
+            [](void *dst, void *src) { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); },
+            [](void *data) { delete *static_cast<Fn **>(data); }
+        };
+        *reinterpret_cast<Fn **>(storage_) = new Fn(std::forward<F>(f));
+        ops_ = &s_ops;
+    }
+
+private:
+    alignas(::max_align_t) unsigned char storage_[INLINE_SIZE];
+    const Ops *ops_;
+};
+
+}
+
+#endif
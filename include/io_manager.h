@@ -4,6 +4,7 @@
 #include "mutex.h"
 #include "timer.h"
 namespace RPC {
+class IoUring;
 /**
  * @brief 基于epoll的IO协程调度管理器(在scheduler的基础上套上了epoll)
  * 总体设计思路 epoll监听事件，将事件分发给协程调度器执行
@@ -19,9 +20,46 @@ public:
     };
 
 
-    IOManager(size_t threads = 4, const std::string &name = "");
+    /**
+     * @param reactor_per_thread 是否每个工作线程使用独立的epoll实例
+     *  开启后句柄在第一次注册事件时绑定到当前线程的epoll, 事件触发后协程回到该线程执行
+     * @param persistent_event 是否使用常驻的边沿触发注册
+     *  开启后hook创建的socket第一次等待时以EPOLLIN|EPOLLOUT|EPOLLET注册, 直到cancelAllEvent(关闭句柄)才移除,
+     *  触发时没有等待者的事件记录在FdContext中, 等待和触发都不再调用epoll_ctl.
+     *  管道等没有fd上下文的句柄可能不经过hook关闭, 仍然一次性注册.
+     *  socket没有经过hook关闭时, 句柄号被hook的socket/accept重新分配时清除留下的注册
+     */
+    IOManager(size_t threads = 4, const std::string &name = "", bool reactor_per_thread = false,
+              bool persistent_event = false);
     ~IOManager();
+    /**
+     * @brief tryAddEvent的结果
+     */
+    enum AddEventResult {
+        ADD_ERROR = 0, // 注册失败
+        ADD_OK,        // 已注册, 事件触发时唤醒
+        ADD_READY,     // 常驻注册模式下事件在上次等待之后已经触发, 没有注册, 调用者直接重试系统调用
+        ADD_BUSY,      // 该方向已经有其他等待者, 没有注册, 调用者需要稍后重新检查
+    };
+    /**
+     * @brief 注册事件, 事件触发时执行callback, callback为空时唤醒当前协程
+     *  事件已经就绪时立即调度, 当前协程会在切出后马上被唤醒
+     */
     bool addEvent(int fd, Event event, std::function<void()> callback = nullptr);
+    /**
+     * @brief 注册事件, 事件已经就绪时不注册也不调度, 返回ADD_READY, 省去一次切出和唤醒;
+     *  该方向已经有等待者时不断言, 返回ADD_BUSY
+     * @param owner 注册者的标识, 之后可以用removeEvent只移除自己的注册
+     */
+    AddEventResult tryAddEvent(int fd, Event event, std::function<void()> callback = nullptr,
+                               const void *owner = nullptr);
+    /**
+     * @brief 移除owner用tryAddEvent注册的事件, 不触发
+     *  事件已经触发(回调可能还没执行)或者触发后被其他等待者重新注册时什么都不做, 也不记录错误
+     * @param owner 注册时的标识, 不能为空
+     * @return 是否移除了事件
+     */
+    bool removeEvent(int fd, Event event, const void *owner);
     /**
      * @brief 直接删除事件
      */
@@ -38,6 +76,50 @@ public:
      * @return false 
      */
     bool cancelAllEvent(int fd);
+    bool isReactorPerThread() const { return reactors_.size() > 1; }
+    bool isPersistentEvent() const { return persistentEvent_; }
+
+    /**
+     * @brief 直接提交给io_uring的IO请求, 字段与io_uring_sqe对应
+     */
+    struct IoRequest {
+        uint8_t opcode = 0;
+        int fd = -1;
+        uint64_t addr = 0;
+        uint32_t len = 0;
+        // 文件偏移, ACCEPT时为addrlen指针, CONNECT时为addrlen
+        uint64_t off = 0;
+        // msg_flags 或 accept_flags
+        uint32_t flags = 0;
+    };
+    /**
+     * @brief 是否启用了io_uring, 未编译或内核不支持时使用epoll
+     */
+    bool hasIoUring() const { return !rings_.empty(); }
+    /**
+     * @brief 把IO请求放入当前线程的io_uring并挂起协程, 请求在协程切出后与其他请求一起提交, 完成时唤醒协程
+     *
+     * @param req IO请求
+     * @param timeout 超时时间(微秒), -1表示不超时, 超时的请求被取消并返回-ECANCELED
+     * @param[out] res 请求的结果, 与系统调用一致, 失败时为-errno
+     * @return 是否通过io_uring执行, false时调用者需要走epoll路径
+     */
+    bool submitIo(const IoRequest &req, uint64_t timeout, int &res);
+    /**
+     * @brief 协程挂起等待其他线程唤醒(如阻塞任务线程池)期间计入等待的事件, 防止调度器提前停止
+     *  唤醒时先提交协程再调用endExternalWait
+     */
+    void beginExternalWait() { ++pendingEventCount_; }
+    void endExternalWait() { --pendingEventCount_; }
+
+    /**
+     * @brief 唤醒epoll_wait的统计, 一次空闲期内只写一次eventfd, 其余的唤醒被合并
+     */
+    struct NotifyStats {
+        uint64_t issued = 0;     // 实际写eventfd的次数
+        uint64_t suppressed = 0; // 已有未处理的唤醒而省略的次数
+    };
+    NotifyStats getNotifyStats() const;
     static IOManager* GetThis() ;
 protected:
 
@@ -46,6 +128,14 @@ protected:
      * 
      */
     void Notify() override;
+    /**
+     * @brief 独立epoll模式下唤醒指定线程的epoll_wait
+     */
+    bool NotifyWorker(size_t index) override;
+    /**
+     * @brief 提交当前线程io_uring中积攒的请求
+     */
+    void onFiberYield() override;
     /**
      * @brief epoll wait
      * 
@@ -58,9 +148,19 @@ protected:
     bool Stopping() override;
 
     void onTimerInsertedAtFront() override;
-    
-    void contextResize(size_t size);
+    /**
+     * @brief 每个工作线程使用自己的时间轮
+     */
+    int getTimerShard() override { return getWorkerIndex(); }
 private:
+    /**
+     * @brief 一轮epoll_wait中触发的本调度器的任务, 统一批量提交
+     */
+    struct TriggerBatch {
+        Scheduler *scheduler = nullptr;
+        std::vector<Fiber::ptr> fibers;
+        std::vector<std::function<void()>> callbacks;
+    };
     /**
      * @brief socket 事件的上下文
      * 
@@ -71,6 +171,7 @@ private:
             Scheduler *scheduler = nullptr; // 事件的协程调度器
             Fiber::ptr fiber; //事件的协程
             std::function<void()> callback; //事件回调函数
+            const void *owner = nullptr; // tryAddEvent的注册者, removeEvent只移除自己的注册
             bool empty() {
                 return !scheduler && !fiber && !callback;
             }
@@ -78,9 +179,18 @@ private:
 
         EventContext& getEventContext(Event event);
         void resetContext(EventContext &event); //重置事件上下文
-        void triggerEvent(Event event); // 触发事件
+        /**
+         * @brief 触发事件
+         * @param batch 不为空时, 属于batch调度器的任务先放入batch, 由调用者批量提交
+         */
+        void triggerEvent(Event event, TriggerBatch *batch = nullptr);
         int fd;              // 事件关联句柄
+        uint32_t generation = 0; // 句柄每次关闭后加一, 与fd一起放入epoll_data, 用来丢弃句柄号复用前的旧事件
+        int reactor = 0;     // 注册到的epoll实例下标
+        std::atomic<uint32_t> uringOps{0}; // 正在io_uring中执行的请求数
         Event events = NONE; // 注册的事件
+        bool registered = false; // 是否常驻注册在epoll中, 只有常驻注册模式下hook跟踪的socket
+        Event ready = NONE;  // 常驻注册模式下触发时没有等待者的事件
         EventContext read;
         EventContext write;
         MutexType mutex;
@@ -88,14 +198,95 @@ private:
 
 
 
+    /**
+     * @brief epoll实例和用于唤醒epoll_wait的eventfd
+     */
+    struct Reactor {
+        int epollfd = -1;
+        int eventfd = -1;
+        // 是否有线程阻塞在该实例的epoll_wait上
+        std::atomic<bool> idle{false};
+        // 已经写入eventfd但还没有被epoll_wait处理, 期间的唤醒不需要再写
+        std::atomic<bool> wakeupPending{false};
+        // 完成通知注册到该实例的io_uring
+        std::vector<IoUring *> rings;
+    };
+    /**
+     * @brief io_uring请求的完成上下文, 放在发起请求的协程栈上
+     */
+    struct IoCompletion {
+        Fiber::ptr fiber;
+        FdContext *context = nullptr;
+        int res = 0;
+    };
+    /**
+     * @brief 句柄没有注册任何事件时选择要绑定的epoll实例
+     *  优先当前工作线程的实例, 非工作线程轮流选择
+     */
+    int pickReactor();
+    void wakeReactor(Reactor *reactor);
+    /**
+     * @brief 获取句柄的事件上下文, 所在的块不存在时分配
+     */
+    FdContext* getContext(int fd);
+    /**
+     * @brief 无锁查找句柄的事件上下文, 所在的块不存在时返回nullptr
+     */
+    FdContext* findContext(int fd) const {
+        if ((unsigned)fd >= MAX_CONTEXTS) {
+            return nullptr;
+        }
+        FdContext *chunk = contextChunks_[fd >> CONTEXT_CHUNK_BITS].load(std::memory_order_acquire);
+        return chunk ? &chunk[fd & (CONTEXT_CHUNK_SIZE - 1)] : nullptr;
+    }
+    /**
+     * @brief 注册到epoll的数据: 低32位是fd, 高位是generation
+     */
+    static uint64_t EventData(const FdContext *context);
+    /**
+     * @brief addEvent和tryAddEvent的实现, callback只在注册成功时被取走
+     * @param try_add 事件已经就绪或已有等待者时直接返回ADD_READY/ADD_BUSY, 否则分别注册后立即触发/断言
+     */
+    AddEventResult doAddEvent(int fd, Event event, std::function<void()> &callback, const void *owner,
+                              bool try_add);
+    /**
+     * @brief 从epoll中移除已注册的事件并清空事件上下文, 不触发, 调用时持有context->mutex
+     */
+    bool unregisterEvent(FdContext *context, Event event);
+    /**
+     * @brief 为每个工作线程创建io_uring, 任何一个创建失败时全部退回epoll
+     */
+    void initIoUring();
+    /**
+     * @brief 收割io_uring的完成事件, 把等待的协程放入batch
+     */
+    void reapIo(IoUring *ring, TriggerBatch &batch);
+    /**
+     * @brief 取消所有io_uring中该句柄的请求
+     */
+    void cancelIo(int fd);
+
 private:
-    int epollfd_;
-    int pipefd_[2];
+    // 共享模式只有一个实例, 独立模式每个工作线程一个实例
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+    std::atomic<size_t> nextReactor_{0};
+    // 是否使用常驻的边沿触发注册
+    bool persistentEvent_;
+    // 每个工作线程一个io_uring, 为空表示使用epoll
+    std::vector<std::shared_ptr<IoUring>> rings_;
 
-    std::vector<FdContext *> fdContext_;
-    RWMutexType mutex_;
+    // 句柄的事件上下文按fd分块存放, 块分配后原子发布, 直到析构才释放, 上下文的地址不会变化
+    static const int CONTEXT_CHUNK_BITS = 8;
+    static const unsigned CONTEXT_CHUNK_SIZE = 1 << CONTEXT_CHUNK_BITS;
+    static const unsigned MAX_CONTEXT_CHUNKS = 1 << 14;
+    static const unsigned MAX_CONTEXTS = CONTEXT_CHUNK_SIZE * MAX_CONTEXT_CHUNKS;
+    std::atomic<FdContext *> contextChunks_[MAX_CONTEXT_CHUNKS];
+    // 分配块时加锁
+    Mutex chunkMutex_;
     /// 当前等待执行的IO事件数量
     std::atomic<size_t> pendingEventCount_ = {0};
+    std::atomic<uint64_t> notifyIssued_{0};
+    std::atomic<uint64_t> notifySuppressed_{0};
 };
 }
 
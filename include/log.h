@@ -12,11 +12,11 @@
 #include <unordered_map>
 #define RPC_LOG_FMT_LEVEL(logger, level, fmt, ...)\
 if (logger->getLevel() <= level)\
-    RPC::LogEventWrap(std::make_shared<RPC::LogEvent>(logger, level, __FILE__, __LINE__, time(0), RPC::GetThreadId(), RPC::GetFiberId(), RPC::Thread::getName())).getLogEvent()->format(fmt, __VA_ARGS__)
+    RPC::LogEventWrap(std::make_shared<RPC::LogEvent>(logger, level, __FILE__, __LINE__, RPC::GetCachedTime(), RPC::GetThreadId(), RPC::GetFiberId(), RPC::Thread::getName())).getLogEvent()->format(fmt, __VA_ARGS__)
 
 #define RPC_LOG_LEVEL(logger, level) \
 if (logger->getLevel() <= level) \
-    RPC::LogEventWrap(std::make_shared<RPC::LogEvent>(logger, level, __FILE__, __LINE__, time(0), RPC::GetThreadId(), RPC::GetFiberId(), RPC::Thread::getName() )).getSS()
+    RPC::LogEventWrap(std::make_shared<RPC::LogEvent>(logger, level, __FILE__, __LINE__, RPC::GetCachedTime(), RPC::GetThreadId(), RPC::GetFiberId(), RPC::Thread::getName() )).getSS()
 #define RPC_LOG_INFO(logger) RPC_LOG_LEVEL(logger, RPC::LogLevel::INFO) 
 #define RPC_LOG_DEBUG(logger) RPC_LOG_LEVEL(logger, RPC::LogLevel::DEBUG)
 #define RPC_LOG_WARN(logger) RPC_LOG_LEVEL(logger, RPC::LogLevel::WARN)
@@ -233,6 +233,10 @@ public:
 
     std::string getName() const { return logger_name_;}
     LogLevel::Level getLevel() const { return level_;}
+    /**
+     * @brief 设置输出的最低级别, 需要在其他线程开始写日志前调用
+     */
+    void setLevel(LogLevel::Level level) { level_ = level; }
 private: 
     std::list<LogAppender::ptr> appender_;
     LogLevel::Level level_;
@@ -0,0 +1,114 @@
+#ifndef __MPMC_QUEUE_H__
+#define __MPMC_QUEUE_H__
+#include "noncopyable.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+namespace RPC {
+/**
+ * @brief 有界无锁多生产者多消费者队列(Dmitry Vyukov的环形队列)
+ *  每个槽位带一个序号, 生产者和消费者各自通过CAS抢占位置, 不需要加锁也不需要分配内存
+ *  队列满时push返回false, 由调用者决定放入溢出队列还是重试
+ */
+template<class T>
+class MPMCQueue : public Noncopyable {
+public:
+    /**
+     * @param capacity 容量, 向上取整到2的幂
+     */
+    explicit MPMCQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        buffer_.reset(new Cell[size]);
+        for (size_t i = 0; i < size; ++i) {
+            buffer_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueuePos_.store(0, std::memory_order_relaxed);
+        dequeuePos_.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 入队, 队列满时返回false且value不会被移动
+     */
+    bool push(T &&value) {
+        Cell *cell;
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &buffer_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽位还没有被消费, 队列已满
+                return false;
+            } else {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 出队, 队列空时返回false
+     */
+    bool pop(T &value) {
+        Cell *cell;
+        size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+        while (true) {
+            cell = &buffer_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 槽位还没有被生产, 队列为空
+                return false;
+            } else {
+                pos = dequeuePos_.load(std::memory_order_relaxed);
+            }
+        }
+        value = std::move(cell->data);
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    /**
+     * @brief 近似的元素数量, 并发修改时只是一个快照
+     */
+    size_t size() const {
+        size_t dequeue = dequeuePos_.load(std::memory_order_relaxed);
+        size_t enqueue = enqueuePos_.load(std::memory_order_relaxed);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    std::unique_ptr<Cell[]> buffer_;
+    size_t mask_;
+    // 生产者和消费者的位置之间用填充隔开一个缓存行, 避免伪共享.
+    // 不用alignas(64): 过度对齐的类型在C++14中new和make_shared都不保证对齐, 包含队列的Scheduler会被错误分配
+    char pad0_[64];
+    std::atomic<size_t> enqueuePos_;
+    char pad1_[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeuePos_;
+    char pad2_[64 - sizeof(std::atomic<size_t>)];
+};
+
+}
+
+#endif
@@ -2,6 +2,9 @@
 #define __MUTEX_H__
 #include "noncopyable.h"
 #include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <list>
 #include <queue>
 #include <memory>
 #include <set>
@@ -12,6 +15,7 @@
 namespace RPC {
 class Fiber;
 class Timer;
+class IOManager;
 template <class T>
 class ScopedLock {
 public:
@@ -21,7 +25,8 @@ public:
     }
 
     ~ScopedLock() {
-        mutex_.unlock();
+        // 已经手动解锁时不能再次解锁, 否则可能释放其他线程持有的锁
+        unlock();
     }
     void lock() {
         if (!lock_) {
@@ -226,6 +231,12 @@ public:
      */
     void wait(); 
     bool waitFor(CoMutex::Lock &lock, uint64_t timeout);
+    /**
+     * @brief 加锁等待唤醒, 超时时间为微秒, -1表示不超时
+     * 
+     * @return 超时返回false
+     */
+    bool waitForUS(CoMutex::Lock &lock, uint64_t timeout_us);
 
 private:
     MutexType mutex_;
@@ -234,6 +245,78 @@ private:
     std::shared_ptr<Timer> timer_; 
 };
 
+/**
+ * @brief 一次挂起的协程, 可以同时登记在多个等待队列中(如同时等待多个channel)
+ *  唤醒、超时和取消通过原子标志竞争, 只有一方成功, 协程只会被提交一次
+ */
+class FiberWaiter : public std::enable_shared_from_this<FiberWaiter>, public Noncopyable {
+public:
+    typedef std::shared_ptr<FiberWaiter> ptr;
+    /**
+     * @brief 在IOManager的协程中创建, 记录当前协程, 等待期间计入IOManager等待的事件
+     */
+    FiberWaiter();
+    /**
+     * @brief 唤醒协程
+     *
+     * @param source 唤醒方, park返回后通过getSource获取
+     * @return 已经被其他方唤醒、超时或取消时返回false
+     */
+    bool wake(const void *source = nullptr);
+    /**
+     * @brief 挂起直到被唤醒, 超时时间为微秒, -1表示不超时
+     *
+     * @return 超时返回false
+     */
+    bool park(uint64_t timeout_us = (uint64_t)-1);
+    /**
+     * @brief 不挂起直接放弃等待
+     *  已经被唤醒时协程已经提交给调度器, 切出一次消耗掉这次调度, 返回false
+     */
+    bool cancel();
+    const void* getSource() const { return source_; }
+private:
+    bool claim();
+private:
+    std::atomic<bool> woken_{false};
+    bool timeout_ = false;
+    const void *source_ = nullptr;
+    std::shared_ptr<Fiber> fiber_;
+    IOManager *iom_;
+};
+
+/**
+ * @brief 挂起协程的等待队列
+ *  等待方先add再检查条件, 条件仍不满足时park; 通知方先改变条件再检查hasWaiters, 有等待者时才加锁唤醒
+ */
+class FiberWaitQueue : public Noncopyable {
+public:
+    typedef SpinLock MutexType;
+    void add(const FiberWaiter::ptr &waiter);
+    void remove(const FiberWaiter::ptr &waiter);
+    /**
+     * @brief 唤醒一个还在等待的协程, 跳过已经被其他队列唤醒或超时的协程
+     */
+    bool notifyOne(const void *source = nullptr);
+    /**
+     * @brief 一次加锁取出最多count个等待者并唤醒, 返回唤醒的数量
+     *  批量出队/入队一次腾出或放入多个位置时使用, 只唤醒一个会让其余等待者一直挂起
+     */
+    size_t notify(size_t count, const void *source = nullptr);
+    void notifyAll(const void *source = nullptr);
+    /**
+     * @brief 通知方改变条件之后调用, 与add配对保证不会漏掉唤醒
+     */
+    bool hasWaiters() const {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return count_.load(std::memory_order_relaxed) > 0;
+    }
+private:
+    MutexType mutex_;
+    std::list<FiberWaiter::ptr> waiters_;
+    std::atomic<size_t> count_{0};
+};
+
 class CoSemaphore : public Noncopyable {
 public:
     CoSemaphore(uint32_t count);
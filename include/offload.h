@@ -0,0 +1,119 @@
+#ifndef __OFFLOAD_H__
+#define __OFFLOAD_H__
+#include "thread.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+namespace RPC {
+class Fiber;
+class IOManager;
+namespace detail {
+/**
+ * @brief 保存在线程池中执行的结果或异常, 交回给挂起的协程
+ */
+template<class R>
+struct OffloadResult {
+    template<class F>
+    void invoke(F &func) { value.reset(new R(func())); }
+    R get() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+    std::unique_ptr<R> value;
+    std::exception_ptr error;
+};
+
+template<>
+struct OffloadResult<void> {
+    template<class F>
+    void invoke(F &func) { func(); }
+    void get() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    std::exception_ptr error;
+};
+}
+
+/**
+ * @brief 执行阻塞调用的线程池, 线程数量固定
+ *  getaddrinfo、读写普通文件、耗时的计算等会阻塞工作线程的调用放到独立的线程中执行,
+ *  发起调用的协程挂起, 完成后回到原来的调度器继续执行, 同一工作线程上的其他协程不受影响
+ */
+class OffloadPool : public Noncopyable {
+public:
+    typedef std::shared_ptr<OffloadPool> ptr;
+    typedef Mutex MutexType;
+    /**
+     * @param threads 线程数量, 线程在第一次提交任务时创建
+     */
+    OffloadPool(size_t threads = 4, const std::string &name = "offload");
+    ~OffloadPool();
+    /**
+     * @brief 执行func, 在IOManager的协程中调用时挂起协程直到执行完成, 否则直接在当前线程执行
+     *  共享栈协程切出后栈内容会被换走, func可能引用栈上的数据, 也直接执行
+     */
+    void run(std::function<void()> func);
+    /**
+     * @brief 同run, 返回func的返回值, func抛出的异常在调用的协程中重新抛出
+     */
+    template<class F>
+    auto call(F &&func) -> typename std::result_of<F&()>::type {
+        typedef typename std::result_of<F&()>::type R;
+        detail::OffloadResult<R> result;
+        run([&func, &result]() {
+            try {
+                result.invoke(func);
+            } catch (...) {
+                result.error = std::current_exception();
+            }
+        });
+        return result.get();
+    }
+    /**
+     * @brief 停止并等待所有线程退出, 队列中剩余的任务会先执行完
+     */
+    void stop();
+    /**
+     * @brief 进程内共用的线程池, 不析构, 退出时可能还有线程阻塞在调用中
+     */
+    static OffloadPool* GetDefault();
+    size_t getThreadCount() const { return threadCount_; }
+private:
+    struct Task {
+        std::function<void()> func;
+        std::shared_ptr<Fiber> fiber;
+        IOManager *iom = nullptr;
+    };
+    void start();
+    void loop();
+private:
+    MutexType mutex_;
+    Semaphore sem_{0};
+    std::deque<Task> tasks_;
+    std::vector<Thread::ptr> threads_;
+    size_t threadCount_;
+    std::string name_;
+    bool stopping_ = false;
+};
+
+/**
+ * @brief 在默认的阻塞线程池中执行func并等待结果
+ */
+template<class F>
+auto Offload(F &&func) -> typename std::result_of<F&()>::type {
+    return OffloadPool::GetDefault()->call(std::forward<F>(func));
+}
+
+}
+
+#endif
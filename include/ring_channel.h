@@ -0,0 +1,362 @@
+#ifndef __RPC_RING_CHANNEL_H__
+#define __RPC_RING_CHANNEL_H__
+#include "mutex.h"
+#include "mpmc_queue.h"
+#include "spsc_queue.h"
+#include "utils.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+namespace RPC {
+/**
+ * @brief 基于定长无锁环形队列的channel
+ *  队列不满/不空时push和pop只有几次原子操作, 不加锁也不分配内存;
+ *  队列满或空时才把协程登记到等待队列挂起, 对方操作后发现有等待者才唤醒.
+ *  容量向上取整到2的幂. 关闭后push和pop都返回false, 剩余的元素在channel析构时释放
+ *
+ * @tparam Queue SPSCQueue<T>(只有一个生产者和一个消费者) 或 MPMCQueue<T>
+ */
+template<typename T, typename Queue>
+class RingChannelImpl : public Noncopyable {
+public:
+    RingChannelImpl(size_t capacity):queue_(capacity), isClosed_(false) {
+    }
+
+    bool push(const T &t) {
+        T value(t);
+        while (true) {
+            if (isClosed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (queue_.push(std::move(value))) {
+                notifyPop();
+                return true;
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            pushWaiters_.add(waiter);
+            // 登记之后重新检查, 期间出队的协程可能没有看到登记
+            bool closed = isClosed_.load(std::memory_order_acquire);
+            bool pushed = !closed && queue_.push(std::move(value));
+            if (closed || pushed) {
+                pushWaiters_.remove(waiter);
+                waiter->cancel();
+                if (pushed) {
+                    notifyPop();
+                }
+                return pushed;
+            }
+            waiter->park();
+            pushWaiters_.remove(waiter);
+        }
+    }
+
+    bool pop(T &t) {
+        return waitForUS((uint64_t)-1, t);
+    }
+
+    /**
+     * @brief 等待time_ms 时间， 读取channel数据
+     */
+    bool waitFor(uint64_t time_ms, T &t) {
+        return waitForUS(time_ms == (uint64_t)-1 ? time_ms : time_ms * 1000, t);
+    }
+
+    /**
+     * @brief 等待time_us微秒， 读取channel数据, -1表示不超时
+     */
+    bool waitForUS(uint64_t time_us, T &t) {
+        uint64_t deadline = time_us == (uint64_t)-1 ? time_us : GetMonotonicUS() + time_us;
+        while (true) {
+            if (isClosed_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            if (queue_.pop(t)) {
+                notifyPush();
+                return true;
+            }
+            uint64_t timeout = (uint64_t)-1;
+            if (deadline != (uint64_t)-1) {
+                uint64_t now = GetMonotonicUS();
+                if (now >= deadline) {
+                    return false;
+                }
+                timeout = deadline - now;
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            popWaiters_.add(waiter);
+            bool closed = isClosed_.load(std::memory_order_acquire);
+            bool popped = !closed && queue_.pop(t);
+            if (closed || popped) {
+                popWaiters_.remove(waiter);
+                waiter->cancel();
+                if (popped) {
+                    notifyPush();
+                }
+                return popped;
+            }
+            bool woken = waiter->park(timeout);
+            popWaiters_.remove(waiter);
+            if (!woken) {
+                return false;
+            }
+        }
+    }
+
+    /**
+     * @brief 不挂起的push, 队列满或已关闭时返回false
+     */
+    bool tryPush(const T &t) {
+        T value(t);
+        if (isClosed_.load(std::memory_order_acquire) || !queue_.push(std::move(value))) {
+            return false;
+        }
+        notifyPop();
+        return true;
+    }
+
+    /**
+     * @brief 不挂起的pop, 队列空或已关闭时返回false
+     */
+    bool tryPop(T &t) {
+        if (isClosed_.load(std::memory_order_acquire) || !queue_.pop(t)) {
+            return false;
+        }
+        notifyPush();
+        return true;
+    }
+
+    /**
+     * @brief 等到channel不为空, 取出最多max个数据追加到items, 只唤醒一轮入队协程
+     * @return 取出的数量, channel关闭时返回0
+     */
+    size_t popBatch(std::vector<T> &items, size_t max = (size_t)-1) {
+        if (max == 0) {
+            return 0;
+        }
+        while (true) {
+            if (isClosed_.load(std::memory_order_acquire)) {
+                return 0;
+            }
+            size_t n = drain(items, max);
+            if (n) {
+                notifyPush(n);
+                return n;
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            popWaiters_.add(waiter);
+            bool closed = isClosed_.load(std::memory_order_acquire);
+            n = closed ? 0 : drain(items, max);
+            if (closed || n) {
+                popWaiters_.remove(waiter);
+                waiter->cancel();
+                if (n) {
+                    notifyPush(n);
+                }
+                return n;
+            }
+            waiter->park();
+            popWaiters_.remove(waiter);
+        }
+    }
+
+    /**
+     * @brief 写入items中的所有数据, 每次放入队列能容纳的部分并唤醒一轮出队协程, 队列满时挂起
+     * @return 写入的数量, 小于items.size()表示channel已关闭
+     */
+    size_t pushBatch(const std::vector<T> &items) {
+        size_t pushed = 0;
+        while (pushed < items.size()) {
+            if (isClosed_.load(std::memory_order_acquire)) {
+                break;
+            }
+            size_t n = fill(items, pushed);
+            if (n) {
+                pushed += n;
+                notifyPop(n);
+                continue;
+            }
+            FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+            pushWaiters_.add(waiter);
+            bool closed = isClosed_.load(std::memory_order_acquire);
+            n = closed ? 0 : fill(items, pushed);
+            if (closed || n) {
+                pushWaiters_.remove(waiter);
+                waiter->cancel();
+                pushed += n;
+                if (n) {
+                    notifyPop(n);
+                }
+                continue;
+            }
+            waiter->park();
+            pushWaiters_.remove(waiter);
+        }
+        return pushed;
+    }
+
+    RingChannelImpl& operator <<(const T &t) {
+        push(t);
+        return *this;
+    }
+    RingChannelImpl& operator >>(T &t) {
+        pop(t);
+        return *this;
+    }
+    operator bool() {
+        return !isClosed_.load(std::memory_order_acquire);
+    }
+    void close() {
+        if (isClosed_.exchange(true)) {
+            return;
+        }
+        pushWaiters_.notifyAll(&pushWaiters_);
+        popWaiters_.notifyAll(&popWaiters_);
+    }
+
+    size_t capacity() const {
+        return queue_.capacity();
+    }
+
+    size_t size() const {
+        return queue_.size();
+    }
+
+    bool empty() const {
+        return !size();
+    }
+
+    /**
+     * @brief 队列满时挂起的入队协程, 唤醒来源是该队列的地址
+     */
+    FiberWaitQueue& getPushWaiters() { return pushWaiters_; }
+    /**
+     * @brief 队列空时挂起的出队协程, 唤醒来源是该队列的地址
+     */
+    FiberWaitQueue& getPopWaiters() { return popWaiters_; }
+
+private:
+    size_t drain(std::vector<T> &items, size_t max) {
+        size_t n = 0;
+        T t;
+        while (n < max && queue_.pop(t)) {
+            items.push_back(std::move(t));
+            ++n;
+        }
+        return n;
+    }
+    size_t fill(const std::vector<T> &items, size_t from) {
+        size_t n = 0;
+        while (from + n < items.size()) {
+            T value(items[from + n]);
+            if (!queue_.push(std::move(value))) {
+                break;
+            }
+            ++n;
+        }
+        return n;
+    }
+    void notifyPush(size_t count = 1) {
+        if (pushWaiters_.hasWaiters()) {
+            pushWaiters_.notify(count, &pushWaiters_);
+        }
+    }
+    void notifyPop(size_t count = 1) {
+        if (popWaiters_.hasWaiters()) {
+            popWaiters_.notify(count, &popWaiters_);
+        }
+    }
+
+private:
+    Queue queue_;
+    std::atomic<bool> isClosed_;
+    /*队列满时挂起的入队协程*/
+    FiberWaitQueue pushWaiters_;
+    /*队列空时挂起的出队协程*/
+    FiberWaitQueue popWaiters_;
+};
+
+/* 基于无锁环形队列的协程通信channel, 接口与Channel相同 */
+template<typename T, typename Queue>
+class RingChannel {
+public:
+    RingChannel(size_t capacity){
+        channel_impl_ = std::make_shared<RingChannelImpl<T, Queue>>(capacity);
+    }
+    bool push(const T &t) {
+        return channel_impl_->push(t);
+    }
+    bool pop(T &t) {
+        return channel_impl_->pop(t);
+    }
+    bool tryPush(const T &t) {
+        return channel_impl_->tryPush(t);
+    }
+    bool tryPop(T &t) {
+        return channel_impl_->tryPop(t);
+    }
+    size_t popBatch(std::vector<T> &items, size_t max = (size_t)-1) {
+        return channel_impl_->popBatch(items, max);
+    }
+    size_t pushBatch(const std::vector<T> &items) {
+        return channel_impl_->pushBatch(items);
+    }
+
+    bool waitFor(uint64_t time_ms, T &t) {
+        return channel_impl_->waitFor(time_ms, t);
+    }
+
+    bool waitForUS(uint64_t time_us, T &t) {
+        return channel_impl_->waitForUS(time_us, t);
+    }
+
+    RingChannel& operator <<(const T &t) {
+       push(t);
+       return *this;
+    }
+
+    RingChannel& operator >>(T &t) {
+        pop(t);
+        return *this;
+    }
+
+    operator bool() {
+        return *channel_impl_;
+    }
+    void close() {
+        return channel_impl_->close();
+    }
+    size_t capacity() const {
+        return channel_impl_->capacity();
+    }
+
+    size_t size() const {
+        return channel_impl_->size();
+    }
+
+    bool empty() {
+        return channel_impl_->empty();
+    }
+    bool unique() const {
+        return channel_impl_.unique();
+    }
+    FiberWaitQueue& getPushWaiters() {
+        return channel_impl_->getPushWaiters();
+    }
+    FiberWaitQueue& getPopWaiters() {
+        return channel_impl_->getPopWaiters();
+    }
+private:
+    std::shared_ptr<RingChannelImpl<T, Queue>> channel_impl_;
+};
+
+/* 只有一个生产者协程和一个消费者协程 */
+template<typename T>
+using SPSCChannel = RingChannel<T, SPSCQueue<T>>;
+
+/* 任意数量的生产者和消费者 */
+template<typename T>
+using MPMCChannel = RingChannel<T, MPMCQueue<T>>;
+
+}
+
+#endif
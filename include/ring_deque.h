@@ -0,0 +1,74 @@
+#ifndef __RING_DEQUE_H__
+#define __RING_DEQUE_H__
+#include <stddef.h>
+#include <memory>
+#include <utility>
+namespace RPC {
+/**
+ * @brief 基于环形数组的双端队列, 容量不足时翻倍扩容, 不会缩容
+ *  std::deque在元素反复进出时会不断分配和释放内存块, 环形数组达到稳定容量后不再分配内存
+ */
+template<class T>
+class RingDeque {
+public:
+    RingDeque() : head_(0), size_(0), capacity_(0) {}
+    RingDeque(const RingDeque &) = delete;
+    RingDeque& operator=(const RingDeque &) = delete;
+
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+
+    T& front() { return buffer_[head_]; }
+    T& back() { return buffer_[(head_ + size_ - 1) & (capacity_ - 1)]; }
+
+    void push_back(T &&value) {
+        if (size_ == capacity_) {
+            grow();
+        }
+        buffer_[(head_ + size_) & (capacity_ - 1)] = std::move(value);
+        ++size_;
+    }
+
+    void push_front(T &&value) {
+        if (size_ == capacity_) {
+            grow();
+        }
+        head_ = (head_ + capacity_ - 1) & (capacity_ - 1);
+        buffer_[head_] = std::move(value);
+        ++size_;
+    }
+
+    /**
+     * @brief 弹出的元素重置为默认值, 及时释放其持有的资源
+     */
+    void pop_front() {
+        buffer_[head_] = T();
+        head_ = (head_ + 1) & (capacity_ - 1);
+        --size_;
+    }
+
+    void pop_back() {
+        back() = T();
+        --size_;
+    }
+private:
+    void grow() {
+        size_t capacity = capacity_ ? capacity_ * 2 : 16;
+        std::unique_ptr<T[]> buffer(new T[capacity]);
+        for (size_t i = 0; i < size_; ++i) {
+            buffer[i] = std::move(buffer_[(head_ + i) & (capacity_ - 1)]);
+        }
+        buffer_.swap(buffer);
+        capacity_ = capacity;
+        head_ = 0;
+    }
+private:
+    std::unique_ptr<T[]> buffer_;
+    size_t head_;
+    size_t size_;
+    size_t capacity_;
+};
+
+}
+
+#endif
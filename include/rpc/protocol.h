@@ -78,13 +78,19 @@ public:
 
     ByteArray::ptr encode() {
         ByteArray::ptr bt = std::make_shared<ByteArray>();
+        encode(bt);
+        bt->setPosition(0);
+        return bt;
+    }
+    /**
+     * @brief 编码追加到bt的当前位置, 多个消息编码到同一个ByteArray后一次发送
+     */
+    void encode(ByteArray::ptr bt) {
         bt->writeFuint8(magic_);
         bt->writeFuint8(version_);
         bt->writeFuint8(type_);
         bt->writeFuint32(sequence_id_);
         bt->writeStringF32(content_);
-        bt->setPosition(0);
-        return bt;
     }
     void decode(ByteArray::ptr bt) {
         magic_ = bt->readFuint8();
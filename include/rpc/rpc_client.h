@@ -5,6 +5,7 @@
 #include "rpc/rpc_session.h"
 #include "rpc/protocol.h"
 #include "channel.h"
+#include "ring_channel.h"
 #include "assert.h"
 #include "timer.h"
 
@@ -32,6 +33,10 @@ public:
     void close();
 
     void setTimeout(uint64_t timeout_ms);
+    /**
+     * @brief 以微秒为单位设置调用超时, 连接超时向上取整到毫秒
+     */
+    void setTimeoutUS(uint64_t timeout_us);
 
     /**
      * @brief 带参数调用
@@ -119,7 +124,7 @@ private:
 
         Protocol::ptr response;
         bool timeout = false;
-        if (!recv_channel.waitFor(timeout_ms_, response)) {
+        if (!recv_channel.waitForUS(timeout_us_, response)) {
             timeout = true;
         }
         {
@@ -173,11 +178,11 @@ private:
     uint32_t sequence_id_;
     /* 请求序列号和调用者协程channel的映射*/
     std::map<uint32_t, Channel<Protocol::ptr>> response_handle_;
-    /* 消息发送通道*/
-    Channel<Protocol::ptr> channel_;
+    /* 消息发送通道, 调用者协程并发写入, handleSend读取, 不满不空时不加锁*/
+    MPMCChannel<Protocol::ptr> channel_;
 
-    /*超时时间*/
-    uint64_t timeout_ms_;
+    /*超时时间(微秒)*/
+    uint64_t timeout_us_;
     /*是否关闭连接*/
     bool is_closed_;
     /*是否自动开启心跳包*/
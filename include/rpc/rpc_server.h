@@ -8,6 +8,7 @@
 #include "rpc/serializer.h"
 #include "channel.h"
 #include "mutex.h"
+#include "offload.h"
 namespace RPC {
 /**
  * @brief 提供服务的RPC服务端
@@ -24,14 +25,25 @@ public:
      * 
      * @param funName 函数名
      * @param fun 
+     * @param offload 是否在阻塞线程池中执行, 用于读写文件、耗时计算等会阻塞工作线程的函数
      */
     template<typename Fun>
-    bool registerMethod(const std::string &funName, Fun fun) {
-        services_[funName] = [fun, this](Serializer serializer, const std::string &arg) {
-            proxy(fun, serializer, arg);
-        };
+    bool registerMethod(const std::string &funName, Fun fun, bool offload = false) {
+        if (offload) {
+            services_[funName] = [fun, this](Serializer serializer, const std::string &arg) {
+                offloadPool_->run([&]() { proxy(fun, serializer, arg); });
+            };
+        } else {
+            services_[funName] = [fun, this](Serializer serializer, const std::string &arg) {
+                proxy(fun, serializer, arg);
+            };
+        }
         return true;
     }
+    /**
+     * @brief 设置执行offload方法的线程池, 需要在start前调用
+     */
+    void setOffloadPool(OffloadPool::ptr pool) { offloadPool_ = pool; }
     void setName(const std::string &name) override;
 
     /**
@@ -111,14 +123,6 @@ protected:
      */
     Serializer call(const std::string &funName, const std::string &args);
 
-    /**
-     * @brief 维持与客户端的心跳定时器
-     * 
-     * @param heartTimer 
-     * @param client 
-     */
-    void update(Timer::ptr &heartTimer, Socket::ptr client);
-
     /* RPC过程实际调用服务端提供函数的过程 */
     template<typename Fun>
     void proxy(Fun func, Serializer serializer, const std::string &arg) {
@@ -165,6 +169,8 @@ protected:
 
 
 private:
+    /* 执行offload方法的线程池 */
+    OffloadPool::ptr offloadPool_;
     /* 注册函数表 */
     std::map<std::string, std::function<void(Serializer, std::string)>> services_; 
     /* 服务注册中心 */
@@ -55,14 +55,6 @@ protected:
      */
     void handleClient(Socket::ptr client) override;
 
-    /**
-     * @brief 添加定时器或更新定时器任务
-     * 
-     * @param timer 
-     * @param client 
-     */
-    void update(Timer::ptr &timer, Socket::ptr client);
-
     /**
      * @brief 处理心跳包
      * 
@@ -2,6 +2,7 @@
 #define __RPC_SESSION_H__
 #include "socket_stream.h"
 #include "mutex.h"
+#include <vector>
 namespace RPC {
 class Protocol;
 /**
@@ -15,6 +16,10 @@ public:
     RPCSession(Socket::ptr socket, bool owner = true);
     std::shared_ptr<Protocol> recvRequest();
     int sendResponse(std::shared_ptr<Protocol> response);
+    /**
+     * @brief 把多个消息编码到同一个ByteArray, 加一次锁用writev一起发送
+     */
+    int sendResponses(const std::vector<std::shared_ptr<Protocol>> &responses);
 private:
     MutexType mutex_;
 };
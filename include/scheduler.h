@@ -3,8 +3,11 @@
 #include "fiber.h"
 #include "thread.h"
 #include "mutex.h"
+#include "mpmc_queue.h"
+#include "inline_function.h"
+#include "ring_deque.h"
 #include <memory>
-#include <list>
+#include <deque>
 #include <vector>
 #include <atomic>
 namespace RPC {
@@ -26,20 +29,90 @@ public:
     void Start();
     void Stop();
 
+    /**
+     * @brief 提交协程或回调任务
+     * 
+     * @param fc 协程或回调函数
+     * @param thread 指定执行的线程id, -1表示不指定
+     * @param shared_stack 回调任务是否在共享栈协程中执行(对提交协程无效)
+     */
     template<class FiberOrCb>
-    Scheduler* Submit(FiberOrCb&& fc, int thread = -1) {
-        bool need_notify = false;
-        {
-            MutexType::Lock lock(mutex_);
-            need_notify = SubmitNoLock(std::forward<FiberOrCb>(fc), thread);
+    Scheduler* Submit(FiberOrCb&& fc, int thread = -1, bool shared_stack = false) {
+        ScheduleTask task(std::forward<FiberOrCb>(fc), thread, shared_stack);
+        if (task.fiber && task.thread == -1) {
+            // 共享栈协程只能回到绑定的线程执行
+            task.thread = task.fiber->getBoundThread();
+        }
+        if (task && SubmitTask(task)) {
+            Notify();
+        }
+        return this;
+    }
+
+    /**
+     * @brief 批量提交协程或回调任务, 所有任务入队后最多通知一次
+     *  提交后区间内的元素会被移走
+     *
+     * @param begin 协程或回调函数区间的起始迭代器
+     * @param end 协程或回调函数区间的结束迭代器
+     * @param thread 指定执行的线程id, -1表示不指定(共享栈协程总是回到绑定的线程)
+     * @param shared_stack 回调任务是否在共享栈协程中执行(对提交协程无效)
+     */
+    template<class InputIterator>
+    Scheduler* SubmitBatch(InputIterator begin, InputIterator end, int thread = -1, bool shared_stack = false) {
+        std::vector<ScheduleTask> tasks;
+        for (; begin != end; ++begin) {
+            ScheduleTask task(std::move(*begin), thread, shared_stack);
+            if (task.fiber && task.fiber->getBoundThread() != -1) {
+                task.thread = task.fiber->getBoundThread();
+            }
+            if (task) {
+                tasks.push_back(std::move(task));
+            }
         }
-        if (need_notify) {
+        if (!tasks.empty() && SubmitTasks(tasks)) {
             Notify();
         }
         return this;
     }
 
     static Scheduler* GetThis();
+
+    /**
+     * @brief 工作线程空闲休眠的统计, 用于权衡自旋时长和唤醒延迟
+     */
+    struct IdleStats {
+        uint64_t spins = 0;     // 进入自旋阶段的次数
+        uint64_t spinHits = 0;  // 自旋期间等到任务的次数
+        uint64_t parks = 0;     // 自旋后仍无任务而休眠的次数
+        uint64_t wakeups = 0;   // 被Notify或定向提交唤醒的次数
+    };
+    IdleStats getIdleStats() const;
+    /**
+     * @brief 设置空闲线程休眠前的自旋次数, 0表示不自旋直接休眠
+     */
+    void setSpinCount(uint32_t count) { spinCount_ = count; }
+    uint32_t getSpinCount() const { return spinCount_; }
+
+    /**
+     * @brief 把工作线程绑定到指定的CPU上, 第i个线程绑定到其中一个CPU, 为空表示不绑定
+     *  Start之后调用时立即重新绑定正在运行的工作线程(IOManager在构造时就已经Start)
+     */
+    void setCpuAffinity(const std::vector<int> &cpus);
+    /**
+     * @brief 按NUMA节点给工作线程分组, 线程只在所在节点的CPU上运行, 窃取任务时优先同节点
+     *  Start之后调用时立即重新分组
+     */
+    void setNumaAware(bool v);
+    bool isNumaAware() const { return numaAware_; }
+    /**
+     * @brief 工作线程所在NUMA节点的系统编号, 与GetCurrentNumaNode一致, 不属于本调度器返回-1
+     */
+    int getThreadNode(int thread);
+    /**
+     * @brief 轮流选择指定NUMA节点上的一个工作线程, 该节点没有工作线程时返回-1
+     */
+    int pickThreadOnNode(int node);
 protected:
     /**
      * @brief 线程执行的调度函数
@@ -68,65 +141,149 @@ protected:
 
     /**
      * @brief 调度器无任务调度时执行wait
-     * 
+     *  先自旋等待一段时间, 仍无任务时在futex上休眠, 直到Notify唤醒
      */
 
     virtual void Wait();
 
     bool hasIdleThreads() { return idleThreads_ > 0;}
+    /**
+     * @brief 当前工作线程是否有能取到的任务(自己的inbox、全局队列或可窃取的任务), 子类的Wait阻塞前检查
+     */
+    bool hasRunnableTask();
+
+    /**
+     * @brief 任务协程切回调度协程后调用, 子类可以在这里批量提交协程执行期间积攒的请求
+     */
+    virtual void onFiberYield() {}
+
+    /**
+     * @brief 唤醒指定下标的工作线程, 用于通知该线程inbox中有任务
+     * @return 是否保证该线程会看到inbox中的任务, 返回false时由调用者退回Notify
+     */
+    virtual bool NotifyWorker(size_t index);
+    /**
+     * @brief 当前线程在本调度器中的工作线程下标, 不是本调度器的工作线程返回-1
+     */
+    int getWorkerIndex();
 private:
     /**
-     * @brief 调度任务结构体
-     * 
+     * @brief 调度任务结构体, 只能移动
+     *  协程任务只移动Fiber::ptr不增减引用计数, 回调任务存放在InlineFunction中, 小的回调不分配内存
      */
     struct ScheduleTask{
         Fiber::ptr fiber;
-        std::function<void()> func;
-        int thread;
-        ScheduleTask() {
-            thread = -1;
-            fiber = nullptr;
-            func = nullptr;
-        }
-        ScheduleTask(Fiber::ptr &f, int t = -1) {
-            fiber = f;
-            thread = t;
-            func = nullptr;
-        }
-        ScheduleTask(std::function<void()> &fc, int t = -1) {
-            func = fc;
-            thread = t;
-            fiber = nullptr;
+        InlineFunction func;
+        int thread = -1;
+        // 回调任务是否在共享栈协程中执行
+        bool sharedStack = false;
+        ScheduleTask() {}
+        ScheduleTask(const Fiber::ptr &f, int t = -1, bool shared = false)
+            :fiber(f), thread(t) {
         }
-        ScheduleTask(Fiber::ptr &&f, int t = -1) {
-            fiber = std::move(f);
-            thread = t;
-            func = nullptr;
+        ScheduleTask(Fiber::ptr &&f, int t = -1, bool shared = false)
+            :fiber(std::move(f)), thread(t) {
         }
-        ScheduleTask(std::function<void()> &&fc, int t = -1) {
-            func = std::move(fc);
-            thread = t;
-            fiber = nullptr;
+        template<class F, class = typename std::enable_if<
+            !std::is_convertible<F, Fiber::ptr>::value
+            && !std::is_same<typename std::decay<F>::type, ScheduleTask>::value>::type>
+        ScheduleTask(F &&fc, int t = -1, bool shared = false)
+            :func(std::forward<F>(fc)), thread(t), sharedStack(shared) {
         }
+        ScheduleTask(ScheduleTask &&) = default;
+        ScheduleTask& operator=(ScheduleTask &&) = default;
         void Reset() {
             fiber = nullptr;
             func = nullptr;
             thread = -1;
+            sharedStack = false;
         }
         operator bool() {
             return fiber || func;
         }
     };
 
-    template<class FiberOrcb>
-    bool SubmitNoLock(FiberOrcb &&fc, int thread) {
-        bool need_notify = tasks_.empty();
-        ScheduleTask task(std::forward<FiberOrcb>(fc), thread);
-        if (task) {
-            tasks_.push_back(task);
-        }
-        return need_notify;
-    }
+    /**
+     * @brief 工作线程的任务队列
+     *  tasks: 本线程提交的任务, 所有者从尾部后进先出, 空闲的线程从头部先进先出地窃取
+     *  inbox: 指定在本线程执行的任务, 不会被其他线程窃取
+     */
+    struct Worker {
+        typedef SpinLock MutexType;
+        MutexType mutex;
+        RingDeque<ScheduleTask> tasks;
+        RingDeque<ScheduleTask> inbox;
+        // 可以被窃取的任务数量, 窃取前无锁检查
+        std::atomic<size_t> stealable{0};
+        // inbox中的任务数量, 休眠前无锁检查
+        std::atomic<size_t> inboxSize{0};
+        std::atomic<int> threadId{-1};
+        // futex等待的地址, 1表示线程正在休眠
+        std::atomic<uint32_t> parked{0};
+        // 工作线程下标
+        size_t index = 0;
+        // 所在NUMA节点的系统编号和绑定的CPU, cpus为空表示不绑定
+        std::atomic<int> node{0};
+        std::vector<int> cpus;
+    };
+
+    /**
+     * @brief 把任务放入合适的队列
+     *  指定线程的任务放入该线程的inbox, 工作线程提交的任务放入本线程队列, 其他线程提交的放入全局队列
+     * @return 是否需要通知其他线程
+     */
+    bool SubmitTask(ScheduleTask &task);
+    /**
+     * @brief 批量放入任务, 同一个队列的任务只加一次锁
+     * @return 是否需要通知其他线程
+     */
+    bool SubmitTasks(std::vector<ScheduleTask> &tasks);
+    /**
+     * @brief 放入全局队列, 环形队列满时放入溢出队列
+     */
+    void PushGlobal(ScheduleTask &task);
+    bool PopGlobal(ScheduleTask &task);
+
+    /**
+     * @brief 依次从inbox, 本线程队列, 全局队列取任务, 都没有时随机窃取其他线程的任务
+     */
+    bool NextTask(Worker *worker, ScheduleTask &task);
+
+    bool StealTask(Worker *worker, ScheduleTask &task);
+    /**
+     * @brief 根据CPU亲和性和NUMA设置计算每个工作线程的节点和绑定的CPU
+     */
+    void PlaceWorkers();
+    /**
+     * @brief Start之后修改了CPU或NUMA设置, 重新计算并绑定正在运行的工作线程, 调用时持有mutex_
+     */
+    void ApplyPlacement();
+    /**
+     * @brief 根据线程id查找工作线程, 不属于本调度器返回nullptr
+     */
+    Worker* FindWorker(int thread);
+    /**
+     * @brief 当前线程对应的工作线程
+     */
+    Worker* GetWorker();
+    /**
+     * @brief 本线程能取到的任务: 自己的inbox和队列, 全局队列, 其他线程可窃取的任务
+     *  其他线程inbox中的任务不算, 它们只能由所属线程执行
+     */
+    bool HasWork(Worker *worker);
+    /**
+     * @brief 任何空闲线程都能取到的任务: 全局队列和所有线程可窃取的任务
+     */
+    bool HasSharedWork();
+    /**
+     * @brief 在futex上休眠, 休眠前再次检查是否有任务, 避免丢失唤醒
+     */
+    void Park(Worker *worker);
+    /**
+     * @brief 唤醒一个休眠的工作线程
+     * @return 该线程是否处于休眠
+     */
+    bool Unpark(Worker *worker);
 
 protected:
     std::vector<int> threadIds_;
@@ -137,7 +294,26 @@ protected:
     std::atomic<size_t> idleThreads_;
     bool stop_;
 private:
-    std::list<ScheduleTask> tasks_;
+    // 全局队列, 存放非工作线程提交的任务
+    MPMCQueue<ScheduleTask> inject_;
+    // 全局队列满时的溢出队列, 由mutex_保护
+    RingDeque<ScheduleTask> tasks_;
+    std::atomic<size_t> overflowCount_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    // 所有队列中等待执行的任务数, 包括指定给其他线程的任务, 只用于判断调度器能否停止
+    std::atomic<size_t> taskCount_;
+    // 在futex上休眠的线程数
+    std::atomic<size_t> parkedThreads_;
+    std::atomic<uint32_t> spinCount_;
+    std::atomic<uint64_t> spins_;
+    std::atomic<uint64_t> spinHits_;
+    std::atomic<uint64_t> parks_;
+    std::atomic<uint64_t> wakeups_;
+    // 工作线程绑定的CPU
+    std::vector<int> cpus_;
+    // 工作线程窃取任务时无锁读取, Start之后也可以修改
+    std::atomic<bool> numaAware_;
+    std::atomic<uint32_t> nodeCursor_;
     std::vector<Thread::ptr> threads_;
     std::string name_;
 
@@ -0,0 +1,171 @@
+#ifndef __RPC_SELECT_H__
+#define __RPC_SELECT_H__
+#include "mutex.h"
+#include "io_manager.h"
+#include "noncopyable.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+namespace RPC {
+/**
+ * @brief 在一个协程中同时等待多个channel的收发、句柄的可读可写和超时, 类似go的select
+ *  先按顺序不挂起地尝试每个case, 都没有就绪时用同一个FiberWaiter登记到所有case的等待队列再挂起,
+ *  任意一个channel的对端操作、句柄事件或超时唤醒协程, 不轮询.
+ *  被channel A唤醒却完成了channel B时, 把唤醒转交给A的下一个等待者, 避免A的数据没有人取.
+ *  取消: 让等待方同时recv一个关闭信号的channel, 关闭该channel即可唤醒所有等待者.
+ *  case在多次wait之间保留, 同一个Select可以在循环中反复wait; recv和send引用的变量必须比Select活得久.
+ *  wait必须在IOManager的协程中调用.
+ *
+ *  Select select;
+ *  int req = select.recv(requests, request);
+ *  int quit = select.recv(done, flag);
+ *  int index = select.wait(timeout_us);
+ *  if (index == req && select.ok()) { ... }
+ */
+class Select : public Noncopyable {
+public:
+    static const int TIMEOUT = -1;
+    Select();
+    ~Select();
+
+    /**
+     * @brief 从channel读取到value, channel可以是Channel或RingChannel
+     * @return case的下标
+     */
+    template<class C, class T>
+    int recv(C &channel, T &value) {
+        return addCase(new RecvCase<C, T>(channel, value));
+    }
+
+    /**
+     * @brief 把value写入channel, 每次wait时读取value当前的值
+     * @return case的下标
+     */
+    template<class C, class T>
+    int send(C &channel, const T &value) {
+        return addCase(new SendCase<C, T>(channel, value));
+    }
+
+    /**
+     * @brief 等待句柄可读或可写, 就绪后由调用者读写, 句柄必须是非阻塞的
+     * @return case的下标
+     */
+    int event(int fd, IOManager::Event event);
+
+    /**
+     * @brief 等待任意一个case完成
+     *
+     * @param timeout_us 超时时间(微秒), -1表示不超时, 0表示只检查一次不挂起(go的default)
+     * @return 完成的case下标, 超时返回TIMEOUT
+     */
+    int wait(uint64_t timeout_us = (uint64_t)-1);
+    int waitFor(uint64_t timeout_ms) {
+        return wait(timeout_ms == (uint64_t)-1 ? timeout_ms : timeout_ms * 1000);
+    }
+    /**
+     * @brief 最近一次完成的case是否成功, channel已关闭或句柄无效时为false
+     *  关闭的channel一直就绪, 调用者应该退出循环或不再等待该Select
+     */
+    bool ok() const { return ok_; }
+    size_t size() const { return cases_.size(); }
+
+private:
+    class Case {
+    public:
+        virtual ~Case() {}
+        /**
+         * @brief 不挂起地尝试完成, channel关闭也算完成, 此时ok为false
+         */
+        virtual bool tryRun(bool &ok) = 0;
+        virtual void add(const FiberWaiter::ptr &waiter) = 0;
+        virtual void remove(const FiberWaiter::ptr &waiter) = 0;
+        /**
+         * @brief 该case唤醒协程时的来源
+         */
+        virtual const void *getSource() const = 0;
+        /**
+         * @brief 该case的唤醒没有被使用, 转交给其他等待者
+         */
+        virtual void renotify() {}
+    };
+
+    template<class C>
+    class ChannelCase : public Case {
+    public:
+        ChannelCase(C &channel, bool recv)
+            :channel_(channel), queue_(recv ? channel_.getPopWaiters() : channel_.getPushWaiters()) {
+        }
+        void add(const FiberWaiter::ptr &waiter) override { queue_.add(waiter); }
+        void remove(const FiberWaiter::ptr &waiter) override { queue_.remove(waiter); }
+        const void *getSource() const override { return &queue_; }
+        void renotify() override {
+            if (queue_.hasWaiters()) {
+                queue_.notifyOne(&queue_);
+            }
+        }
+    protected:
+        // 持有一份channel, 保证等待队列在Select析构前有效
+        C channel_;
+        FiberWaitQueue &queue_;
+    };
+
+    template<class C, class T>
+    class RecvCase : public ChannelCase<C> {
+    public:
+        RecvCase(C &channel, T &value):ChannelCase<C>(channel, true), value_(value) {}
+        bool tryRun(bool &ok) override {
+            if (this->channel_.tryPop(value_)) {
+                ok = true;
+                return true;
+            }
+            if (!this->channel_) {
+                ok = false;
+                return true;
+            }
+            return false;
+        }
+    private:
+        T &value_;
+    };
+
+    template<class C, class T>
+    class SendCase : public ChannelCase<C> {
+    public:
+        SendCase(C &channel, const T &value):ChannelCase<C>(channel, false), value_(value) {}
+        bool tryRun(bool &ok) override {
+            if (this->channel_.tryPush(value_)) {
+                ok = true;
+                return true;
+            }
+            if (!this->channel_) {
+                ok = false;
+                return true;
+            }
+            return false;
+        }
+    private:
+        const T &value_;
+    };
+
+    class EventCase;
+
+    int addCase(Case *c);
+    /**
+     * @brief 从start开始依次尝试所有case, 返回完成的下标
+     */
+    int tryCases(size_t start);
+    /**
+     * @brief 协程被source唤醒但完成的是index, 把唤醒转交给source对应的case
+     */
+    void passOn(const void *source, int index);
+
+private:
+    std::vector<std::unique_ptr<Case>> cases_;
+    // 每次wait从下一个case开始检查, 避免排在前面一直就绪的case饿死后面的
+    size_t next_ = 0;
+    bool ok_ = false;
+};
+
+}
+
+#endif
@@ -88,6 +88,13 @@ public:
     uint64_t getSendTimeout() const;
     void setRecvTimeout(uint64_t t);
     uint64_t getRecvTimeout();
+    /**
+     * @brief 以微秒为单位设置/获取收发超时, 用于亚毫秒级的超时
+     */
+    void setSendTimeoutUS(uint64_t us);
+    uint64_t getSendTimeoutUS() const;
+    void setRecvTimeoutUS(uint64_t us);
+    uint64_t getRecvTimeoutUS();
 
 
     bool bind(const RPC::Address::ptr address);
@@ -0,0 +1,92 @@
+#ifndef __SPSC_QUEUE_H__
+#define __SPSC_QUEUE_H__
+#include "noncopyable.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <utility>
+namespace RPC {
+/**
+ * @brief 有界无锁单生产者单消费者队列
+ *  只允许一个线程(协程)push、一个线程(协程)pop, 双方只写自己的位置,
+ *  对方的位置先读本地缓存, 缓存显示满或空时才重新读取, 大多数操作不碰对方的缓存行
+ */
+template<class T>
+class SPSCQueue : public Noncopyable {
+public:
+    /**
+     * @param capacity 容量, 向上取整到2的幂
+     */
+    explicit SPSCQueue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        buffer_.reset(new T[size]);
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+        cachedHead_ = 0;
+        cachedTail_ = 0;
+    }
+
+    /**
+     * @brief 入队, 队列满时返回false且value不会被移动
+     */
+    bool push(T &&value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ > mask_) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ > mask_) {
+                return false;
+            }
+        }
+        buffer_[tail & mask_] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 出队, 队列空时返回false
+     */
+    bool pop(T &value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_) {
+                return false;
+            }
+        }
+        value = std::move(buffer_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return mask_ + 1; }
+    /**
+     * @brief 近似的元素数量, 并发修改时只是一个快照
+     */
+    size_t size() const {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+private:
+    std::unique_ptr<T[]> buffer_;
+    size_t mask_;
+    // 消费者和生产者的字段之间用填充隔开一个缓存行, 与MPMCQueue一样不用alignas, 见mpmc_queue.h
+    char pad0_[64];
+    // 消费者的位置和消费者缓存的生产者位置
+    std::atomic<size_t> head_;
+    size_t cachedTail_;
+    char pad1_[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    // 生产者的位置和生产者缓存的消费者位置
+    std::atomic<size_t> tail_;
+    size_t cachedHead_;
+    char pad2_[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
+
+}
+
+#endif
@@ -19,6 +19,11 @@ public:
     virtual void startAccept(Socket::ptr sock);
     virtual void setName(const std::string &name) { name_ = name;}
     std::string getName() { return name_;}
+    /**
+     * @brief 设置客户端连接的处理协程是否使用共享栈, 适合大量空闲长连接的场景
+     */
+    void setSharedStack(bool v) { sharedStack_ = v;}
+    bool isSharedStack() const { return sharedStack_;}
 protected:
     virtual void handleClient(Socket::ptr client);
 protected:
@@ -27,6 +32,7 @@ protected:
     IOManager* acceptWorker_;
     bool stop_;
     std::string name_; // 服务器的名称
+    bool sharedStack_; // 连接处理协程是否使用共享栈
 };
 
 
@@ -3,6 +3,7 @@
 #include "my_semaphore.h"
 #include <memory>
 #include <functional>
+#include <vector>
 namespace RPC {
 class Thread {
 public:
@@ -16,6 +17,14 @@ public:
     static void* run(void *arg);
     static Thread *GetThis();
     static void SetName(const std::string& name);
+    /**
+     * @brief 把当前线程绑定到指定的CPU集合上
+     */
+    static bool SetAffinity(const std::vector<int> &cpus);
+    /**
+     * @brief 把该线程绑定到指定的CPU集合上, 可以在其他线程调用, cpus为空表示可以在所有CPU上运行
+     */
+    bool setAffinity(const std::vector<int> &cpus);
 
 private:
     Thread(const Thread& thread) = delete;
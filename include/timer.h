@@ -2,8 +2,11 @@
 #define __TIMER_H__
 #include "thread.h"
 #include "mutex.h"
+#include "utils.h"
 #include <stdint.h>
-#include <set>
+#include <atomic>
+#include <list>
+#include <memory>
 #include <vector>
 /**
  * @brief 定时器封装
@@ -12,27 +15,20 @@
 namespace RPC {
 
 class TimerManager;
+class TimerWheel;
 class Timer :public std::enable_shared_from_this<Timer>{
 public:
     typedef std::shared_ptr<Timer> ptr;
     friend class TimerManager;
+    friend class TimerWheel;
 private:
     /**
-     * @param ms 毫秒
+     * @param us 微秒
      * @param callback 回调函数
      * @param recurring 是否循环定时器
      * @param manager 
      */
-    Timer(uint64_t ms, std::function<void()> callback, bool recurring, TimerManager *manager);
-    /**
-     * @brief 仅使用绝对时间构造，该构造方法只用于比较查询
-     * 
-     * @param next 
-     */
-    Timer(uint64_t next);
-    struct Comparator {
-        bool operator() (const Timer::ptr &lhs, const Timer::ptr &rhs) const;
-    };
+    Timer(uint64_t us, std::function<void()> callback, bool recurring, TimerManager *manager);
 public:
     /**
      * @brief 取消定时器（删除定时器）
@@ -49,45 +45,206 @@ public:
      * 
      */
     bool reset(uint64_t ms, bool from_now);
+    /**
+     * @brief 以微秒为单位重置
+     */
+    bool resetUS(uint64_t us, bool from_now);
 private:
-    uint64_t ms_; //相对时间， 相对目前多少时间间隔后执行
-    uint64_t next_; // 绝对时间， 在哪个时间执行
+    /**
+     * @brief 锁住定时器所在的时间轮, 定时器可能同时被其他线程移走, 加锁后需要重新确认
+     */
+    TimerWheel* lockWheel();
+    /**
+     * @brief 到期时间改变后移到当前线程的时间轮, 调用时持有wheel的锁, 返回前释放
+     */
+    void moveToCurrent(TimerWheel *wheel);
+private:
+    uint64_t us_; //相对时间(微秒)， 相对目前多少时间间隔后执行
+    uint64_t next_; // 绝对时间(微秒)， 在哪个时间执行
     std::function<void()> callback_;
     bool recurring_;
     TimerManager *manager_;
+    // 所属的时间轮, 以下字段和callback_都由该时间轮的锁保护
+    std::atomic<TimerWheel *> wheel_;
+    // 所在时间轮的层和槽, level_为-1表示不在时间轮中
+    int level_;
+    uint32_t slot_;
+    // 在槽链表中的位置, 取消和重置时O(1)摘除或移动
+    std::list<Timer::ptr>::iterator pos_;
 };
 
+/**
+ * @brief 分层时间轮
+ *  第0层256个槽, 每个槽1毫秒; 第1~4层每层64个槽, 每个槽覆盖下一层一整圈, 总跨度2^32毫秒
+ *  添加、取消、重置都只是链表操作, 到期时间由advance逐毫秒推进, 除size外所有操作都需要持有mutex
+ *  定时器的到期时间精确到微秒, 当前这一毫秒的槽只取出已经到期的定时器, 其余的留到下次推进
+ */
+class TimerWheel : public Noncopyable {
+public:
+    typedef SpinLock MutexType;
+    TimerWheel();
+
+    MutexType& mutex() { return mutex_; }
+    size_t size() const { return count_; }
+    /**
+     * @brief 放入时间轮
+     */
+    void link(const Timer::ptr &timer);
+    /**
+     * @brief 到期时间改变后移动到新的槽
+     */
+    void relink(Timer *timer);
+    /**
+     * @brief 从时间轮中摘除
+     */
+    void unlink(Timer *timer);
+    /**
+     * @brief 推进到now(微秒), 到期的定时器移入expired
+     */
+    void advance(uint64_t now, std::list<Timer::ptr> &expired);
+    /**
+     * @brief now(微秒)时是否可能有到期的定时器, 拥有该时间轮的线程可以不加锁调用
+     */
+    bool isDue(uint64_t now) const { return count_ > 0 && due_.load(std::memory_order_relaxed) <= now; }
+    /**
+     * @brief 最近需要处理的时间(微秒): 第0层中最早的定时器或者上层下放定时器的时间
+     */
+    uint64_t nextExpire() const;
+    /**
+     * @brief 到期时间早于epoll_wait等待的时间时更新, 返回是否需要唤醒
+     */
+    bool updateNearest(uint64_t next);
+    void setNearest(uint64_t next) { nearest_ = next; }
+private:
+    static const int ROOT_BITS = 8;
+    static const int WHEEL_BITS = 6;
+    static const int WHEEL_LEVELS = 4;
+    static const uint32_t ROOT_SIZE = 1 << ROOT_BITS;
+    static const uint32_t WHEEL_SIZE = 1 << WHEEL_BITS;
+
+    std::list<Timer::ptr>& bucket(int level, uint32_t slot);
+    /**
+     * @brief 根据到期时间计算定时器所在的槽, 设置level_和slot_
+     */
+    std::list<Timer::ptr>& locate(Timer *timer);
+    /**
+     * @brief current_到了整圈时把上层对应的槽下放
+     */
+    void cascade();
+    /**
+     * @brief current_这一毫秒的槽中到期时间不晚于now的定时器移入expired
+     */
+    void expireSlot(uint64_t now, std::list<Timer::ptr> &expired);
+    bool rootEmpty() const;
+private:
+    MutexType mutex_;
+    std::list<Timer::ptr> root_[ROOT_SIZE];
+    std::list<Timer::ptr> wheels_[WHEEL_LEVELS][WHEEL_SIZE];
+    // 第0层非空槽的位图
+    uint64_t rootBitmap_[ROOT_SIZE / 64];
+    // 正在处理的毫秒, 之前的槽都已经处理完
+    uint64_t current_;
+    // 时间轮中的定时器数量
+    std::atomic<size_t> count_;
+    // 下一次需要推进的时间(微秒), 只会早于实际的到期时间
+    std::atomic<uint64_t> due_;
+    // epoll_wait正在等待的最近到期时间(微秒)
+    std::atomic<uint64_t> nearest_;
+};
+
+/**
+ * @brief 定时器管理, 每个工作线程一个时间轮, 另有一个公共时间轮存放其他线程添加的定时器
+ *  定时器放入添加它的线程的时间轮, 由该线程推进和执行, 通常不会有锁竞争;
+ *  其他线程取消时锁住所属的时间轮, 重置和刷新时把定时器移到当前线程的时间轮
+ */
 class TimerManager {
 public:
     friend class Timer;
     typedef std::shared_ptr<TimerManager> ptr;
-    typedef RWMutex RWMutexType;
-    TimerManager();
+    /**
+     * @param shards 工作线程的数量
+     */
+    TimerManager(size_t shards = 0);
     virtual ~TimerManager();
     Timer::ptr addTimer(uint64_t ms, std::function<void()> callaback, bool recurring = false);
     Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> callback, std::weak_ptr<void> weak_cond, bool recurring = false);
-    void addTimer(Timer::ptr timer, RWMutexType::WriteLock &lock);
     /**
-     * @brief 过多少毫秒下一个定时器执行
+     * @brief 添加微秒精度的定时器, 用于亚毫秒级的超时
+     */
+    Timer::ptr addTimerUS(uint64_t us, std::function<void()> callaback, bool recurring = false);
+    Timer::ptr addConditionTimerUS(uint64_t us, std::function<void()> callback, std::weak_ptr<void> weak_cond, bool recurring = false);
+    /**
+     * @brief 过多少毫秒下一个定时器执行(向上取整), 只看当前线程的时间轮和公共时间轮
      * 
      * @return uint64_t 
      */
     uint64_t getNextTimerTime();
     /**
-     * @brief 返回已经超时的计时器的回调函数
+     * @brief 过多少微秒下一个定时器执行, 没有定时器返回~0ull
+     */
+    uint64_t getNextTimerTimeUS();
+    /**
+     * @brief 返回当前线程的时间轮和公共时间轮中已经超时的计时器的回调函数
      * 
      * @param cb 回调函数列表
      */
     void listOverTimeCallback(std::vector<std::function<void()>> &cb);
+    /**
+     * @brief 当前线程的时间轮是否有需要处理的定时器, 不加锁
+     */
+    bool hasExpiredTimer();
+    /**
+     * @brief 所有时间轮中是否还有定时器
+     */
+    bool hasTimer();
 protected:
     /**
-     * @brief 新建计时器在集合最前端，唤醒epoll_wait协程，重新设置epoll_Wait时间
-     * 
+     * @brief 新建计时器在公共时间轮最前端，唤醒epoll_wait协程，重新设置epoll_Wait时间
+     *  工作线程的时间轮只由正在运行的拥有者线程添加, 不需要唤醒
      */
     virtual void onTimerInsertedAtFront() = 0;
+    /**
+     * @brief 当前线程对应的时间轮下标, -1表示使用公共时间轮
+     */
+    virtual int getTimerShard() { return -1; }
+private:
+    TimerWheel* currentWheel();
+    /**
+     * @brief 放入当前线程的时间轮
+     */
+    void addTimer(const Timer::ptr &timer);
+    void listExpired(TimerWheel *wheel, uint64_t now, std::vector<std::function<void()>> &cb);
+private:
+    // 前shards个属于工作线程, 最后一个是公共时间轮
+    std::vector<std::unique_ptr<TimerWheel>> wheels_;
+};
+
+/**
+ * @brief 连接空闲超时检测, 收到消息时只记录时间戳, 不修改定时器
+ *  定时器到期时检查最后活动的时间, 期间有活动则按剩余时间重新检查, 真正空闲时才执行回调
+ *  对象析构时取消定时器
+ */
+class IdleTimer {
+public:
+    typedef std::shared_ptr<IdleTimer> ptr;
+    static IdleTimer::ptr Create(TimerManager *manager, uint64_t timeout, std::function<void()> callback);
+    ~IdleTimer();
+    /**
+     * @brief 记录一次活动
+     */
+    void touch() { lastActive_.store(GetCachedMS(), std::memory_order_relaxed); }
+    uint64_t getTimeout() const { return timeout_; }
 private:
-    std::set<Timer::ptr, Timer::Comparator> timers_;
-    RWMutexType mutex_;
+    IdleTimer(uint64_t timeout, std::function<void()> callback);
+    void onTimer();
+private:
+    typedef SpinLock MutexType;
+    uint64_t timeout_;
+    std::atomic<uint64_t> lastActive_;
+    std::function<void()> callback_;
+    // 保护timer_: 定时器可能在Create赋值之前就在其他工作线程上到期
+    MutexType mutex_;
+    Timer::ptr timer_;
 };
 
 }
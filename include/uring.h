@@ -0,0 +1,106 @@
+#ifndef __URING_H__
+#define __URING_H__
+#include "mutex.h"
+#include "noncopyable.h"
+#include <linux/io_uring.h>
+#include <stdint.h>
+#include <memory>
+namespace RPC {
+/**
+ * @brief io_uring实例的封装, 直接使用系统调用, 不依赖liburing
+ *  提交队列由sqMutex保护, 完成队列由内部的锁保护, 可以在任意线程收割
+ *  完成事件通过注册的eventfd通知, eventfd可以放入epoll中等待
+ */
+class IoUring : public Noncopyable {
+public:
+    typedef std::shared_ptr<IoUring> ptr;
+    typedef SpinLock MutexType;
+    IoUring();
+    ~IoUring();
+    /**
+     * @brief 创建io_uring实例并注册eventfd
+     * @return 内核不支持或被禁用时返回false
+     */
+    bool init(unsigned entries);
+
+    MutexType& sqMutex() { return sqMutex_; }
+    /**
+     * @brief 提交队列剩余的空位, 需要持有sqMutex
+     */
+    unsigned sqSpace() const;
+    /**
+     * @brief 取一个清零的sqe, 填充后由submit统一提交, 需要持有sqMutex
+     */
+    io_uring_sqe* getSqe();
+    /**
+     * @brief 一次系统调用提交所有准备好的sqe, 需要持有sqMutex
+     * @return 提交的数量, 失败返回-1
+     */
+    int submit();
+    bool hasPending() const { return pending_ > 0; }
+
+    int getEventFd() const { return eventfd_; }
+
+    /**
+     * @brief 收割所有完成事件
+     * @param cb 对每个完成事件调用 cb(user_data, res)
+     * @return 收割的数量
+     */
+    template<class Callback>
+    unsigned reap(Callback cb) {
+        MutexType::Lock lock(cqMutex_);
+        unsigned count = 0;
+        while (true) {
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                if (!flushOverflow()) {
+                    break;
+                }
+                continue;
+            }
+            for (; head != tail; ++head, ++count) {
+                io_uring_cqe *cqe = &cqes_[head & cqMask_];
+                cb(cqe->user_data, cqe->res);
+            }
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        }
+        return count;
+    }
+private:
+    /**
+     * @brief 完成队列溢出时让内核把积压的完成事件放回队列
+     * @return 是否有积压的完成事件
+     */
+    bool flushOverflow();
+private:
+    int fd_;
+    int eventfd_;
+    MutexType sqMutex_;
+    MutexType cqMutex_;
+
+    void *sqRing_;
+    size_t sqRingSize_;
+    void *cqRing_;
+    size_t cqRingSize_;
+    io_uring_sqe *sqes_;
+    size_t sqesSize_;
+
+    unsigned *sqHead_;
+    unsigned *sqTail_;
+    unsigned *sqFlags_;
+    unsigned *sqArray_;
+    unsigned sqMask_;
+    unsigned sqEntries_;
+    // 已经放入提交队列但还没有提交给内核的数量
+    unsigned pending_;
+
+    unsigned *cqHead_;
+    unsigned *cqTail_;
+    unsigned cqMask_;
+    io_uring_cqe *cqes_;
+};
+
+}
+
+#endif
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <byteswap.h>
 #include <type_traits>
+#include <vector>
 
 
 
@@ -17,6 +18,54 @@ pid_t GetThreadId();
 uint64_t GetFiberId();
 uint64_t GetCurrentMS();
 uint64_t GetCurrentUS();
+/**
+ * @brief 单调时钟的毫秒/微秒数, 每次都读取时钟, 不受系统时间调整影响, 精度要求高时使用
+ */
+uint64_t GetMonotonicMS();
+uint64_t GetMonotonicUS();
+/**
+ * @brief 当前线程缓存的单调时钟毫秒数, 定时器使用
+ *  IOManager的线程在每次epoll_wait返回时刷新, 每个协程切出后标记过期, 过期后第一次读取时才刷新,
+ *  不读取时间的协程切换不需要读时钟. 从未刷新过的线程直接读取时钟
+ */
+uint64_t GetCachedMS();
+/**
+ * @brief 当前线程缓存的单调时钟微秒数, 微秒定时器使用
+ *  开启CLOCK_USE_COARSE时粗粒度时钟的精度只有几毫秒, 微秒定时器会退化为该精度
+ */
+uint64_t GetCachedUS();
+/**
+ * @brief 当前线程缓存的系统时间(秒), 日志使用
+ */
+uint64_t GetCachedTime();
+/**
+ * @brief 刷新当前线程缓存的时间
+ */
+void UpdateCachedClock();
+/**
+ * @brief 标记当前线程缓存的时间已过期, 下一次读取缓存时间时再刷新
+ */
+void InvalidateCachedClock();
+/**
+ * @brief 读取NUMA拓扑, 返回每个节点的CPU列表, 按节点编号排序
+ *  无法读取/sys时返回包含所有在线CPU的单个节点
+ * @param ids 不为空时填入每个节点的系统编号(/sys中的nodeN), 与返回值一一对应
+ */
+std::vector<std::vector<int>> GetNumaNodeCpus(std::vector<int> *ids = nullptr);
+/**
+ * @brief 当前线程所在CPU的NUMA节点的系统编号, 未知时返回0
+ */
+int GetCurrentNumaNode();
+/**
+ * @brief 自旋等待时让出流水线, 降低自旋对同核超线程的影响
+ */
+inline void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
 
 template <class T>
 typename std::enable_if<sizeof(T) == sizeof(uint64_t), T>::type
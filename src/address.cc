@@ -1,11 +1,116 @@
 #include "address.h"
 #include "log.h"
+#include "mutex.h"
+#include "offload.h"
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <ifaddrs.h>
+#include <unordered_map>
 namespace RPC {
 static Logger::ptr logger = RPC_LOG_ROOT();
 
+/**
+ * @brief 域名解析的缓存, 不析构, 退出时阻塞线程池中可能还有正在进行的解析
+ */
+struct LookupCache {
+    struct Entry {
+        std::vector<Address::ptr> address;
+        int error = 0;
+        uint64_t expire = 0;
+    };
+    static const size_t MAX_ENTRIES = 4096;
+    Mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    uint64_t positiveTTL = 60 * 1000;
+    uint64_t negativeTTL = 5 * 1000;
+};
+
+static LookupCache& GetLookupCache() {
+    static LookupCache *cache = new LookupCache;
+    return *cache;
+}
+
+/**
+ * @brief 缓存的地址会被多个调用者取走, 返回副本以免调用者修改(如setPort)影响缓存
+ */
+static void CopyAddress(std::vector<Address::ptr> &result, const std::vector<Address::ptr> &address) {
+    for (auto &i : address) {
+        result.push_back(Address::Create(i->getSockAddr(), i->getSockAddrLen()));
+    }
+}
+
+/**
+ * @brief 数字形式的ip和端口直接构造地址, 只返回一个地址(getaddrinfo会按socket类型各返回一个相同的地址)
+ */
+static bool LookupNumeric(std::vector<Address::ptr> &address, const std::string &node, const char *service, int family) {
+    uint32_t port = 0;
+    if (service) {
+        if (!*service) {
+            return false;
+        }
+        for (const char *p = service; *p; ++p) {
+            if (*p < '0' || *p > '9' || port > 65535) {
+                return false;
+            }
+            port = port * 10 + (*p - '0');
+        }
+        if (port > 65535) {
+            return false;
+        }
+    }
+    if (family == AF_INET || family == AF_UNSPEC) {
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        if (inet_pton(AF_INET, node.c_str(), &addr.sin_addr) == 1) {
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            address.push_back(Address::ptr(new IPv4Address(addr)));
+            return true;
+        }
+    }
+    if (family == AF_INET6 || family == AF_UNSPEC) {
+        sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        if (inet_pton(AF_INET6, node.c_str(), &addr.sin6_addr) == 1) {
+            addr.sin6_family = AF_INET6;
+            addr.sin6_port = htons(port);
+            address.push_back(Address::ptr(new IPv6Address(addr)));
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 域名确定不存在时才缓存失败的结果, 临时错误(EAI_AGAIN等)下次重新解析
+ */
+static bool IsPermanentLookupError(int error) {
+    switch (error) {
+        case EAI_NONAME:
+        case EAI_FAIL:
+#ifdef EAI_NODATA
+        case EAI_NODATA:
+#endif
+            return true;
+        default:
+            return false;
+    }
+}
+
+void Address::SetLookupCacheTTL(uint64_t positive_ms, uint64_t negative_ms) {
+    LookupCache &cache = GetLookupCache();
+    Mutex::Lock lock(cache.mutex);
+    cache.positiveTTL = positive_ms;
+    cache.negativeTTL = negative_ms;
+    cache.entries.clear();
+}
+
+void Address::ClearLookupCache() {
+    LookupCache &cache = GetLookupCache();
+    Mutex::Lock lock(cache.mutex);
+    cache.entries.clear();
+}
+
 template<class T>
 static T CreateMask(uint32_t bit) {
     // 0000000011111
@@ -73,19 +178,75 @@ bool Address::Lookup(std::vector<Address::ptr> &address, const std::string &host
     if (node.empty()) {
         node = host;
     }
-    int error = getaddrinfo(node.c_str(), service, &hints, &results);
+    if (LookupNumeric(address, node, service, family)) {
+        return true;
+    }
+
+    LookupCache &cache = GetLookupCache();
+    std::string key = host + "|" + std::to_string(family) + "|" + std::to_string(type)
+                        + "|" + std::to_string(protocol);
+    uint64_t now = GetMonotonicMS();
+    {
+        Mutex::Lock lock(cache.mutex);
+        auto it = cache.entries.find(key);
+        if (it != cache.entries.end()) {
+            if (it->second.expire > now) {
+                if (it->second.error) {
+                    return false;
+                }
+                CopyAddress(address, it->second.address);
+                return true;
+            }
+            cache.entries.erase(it);
+        }
+    }
+
+    // 协程挂起期间getaddrinfo在阻塞线程池中执行, 栈上的变量仍然有效
+    int error = 0;
+    std::vector<Address::ptr> result;
+    OffloadPool::GetDefault()->run([&]() {
+        error = getaddrinfo(node.c_str(), service, &hints, &results);
+        if (error != 0) {
+            return;
+        }
+        for (next = results; next; next = next->ai_next) {
+            result.push_back(Create(next->ai_addr, (socklen_t)next->ai_addrlen));
+        }
+        freeaddrinfo(results);
+    });
     if (error != 0) {
         RPC_LOG_ERROR(logger) << "Address::Lookup getaddress(" << host << ", "
             << family << ", " << type << ") err=" << error << " errstr="
             << gai_strerror(error);
-        return false;
     }
-    next = results;
-    while (next) {
-        address.push_back(Create(next->ai_addr, (socklen_t)next->ai_addrlen));
-        next = next->ai_next;
+
+    {
+        Mutex::Lock lock(cache.mutex);
+        uint64_t ttl = error ? (IsPermanentLookupError(error) ? cache.negativeTTL : 0) : cache.positiveTTL;
+        if (ttl) {
+            if (cache.entries.size() >= LookupCache::MAX_ENTRIES) {
+                now = GetMonotonicMS();
+                for (auto it = cache.entries.begin(); it != cache.entries.end();) {
+                    if (it->second.expire <= now) {
+                        it = cache.entries.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                if (cache.entries.size() >= LookupCache::MAX_ENTRIES) {
+                    cache.entries.clear();
+                }
+            }
+            LookupCache::Entry &entry = cache.entries[key];
+            entry.address = result;
+            entry.error = error;
+            entry.expire = GetMonotonicMS() + ttl;
+        }
+    }
+    if (error != 0) {
+        return false;
     }
-    freeaddrinfo(results);
+    CopyAddress(address, result);
     return true;
 }
 
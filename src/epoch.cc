@@ -0,0 +1,133 @@
+#include "epoch.h"
+#include "mutex.h"
+#include "macro.h"
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <vector>
+namespace RPC {
+
+/**
+ * @brief 线程的读者记录, 线程退出后留给其他线程复用, 不会释放
+ */
+struct EpochRecord {
+    // 前后填充, 各线程频繁写入的epoch独占缓存行
+    char pad0[64];
+    // 0表示不在临界区, 否则为进入临界区时的epoch
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> used{false};
+    EpochRecord *next = nullptr;
+    char pad1[64];
+};
+
+struct RetiredObject {
+    // 摘除时的epoch
+    uint64_t epoch;
+    std::shared_ptr<void> obj;
+};
+
+struct EpochState {
+    // 从1开始, 0留给不在临界区的记录
+    std::atomic<uint64_t> epoch{1};
+    // 只增加不删除的读者记录链表
+    std::atomic<EpochRecord *> records{nullptr};
+    Mutex mutex;
+    std::vector<RetiredObject> retired;
+};
+
+/**
+ * @brief 不析构, 线程退出时还会访问读者记录, 可能晚于静态对象析构
+ */
+static EpochState& GetState() {
+    static EpochState *state = new EpochState;
+    return *state;
+}
+
+/**
+ * @brief 线程退出时归还读者记录
+ */
+struct EpochRecordReleaser {
+    EpochRecord *record = nullptr;
+    ~EpochRecordReleaser() {
+        if (record) {
+            record->used.store(false, std::memory_order_release);
+        }
+    }
+};
+
+// 热路径只访问可以平凡析构的线程局部变量
+static thread_local EpochRecord *t_record = nullptr;
+static thread_local int t_depth = 0;
+static thread_local EpochRecordReleaser t_releaser;
+
+static EpochRecord* AcquireRecord() {
+    EpochState &state = GetState();
+    EpochRecord *record = nullptr;
+    for (EpochRecord *r = state.records.load(std::memory_order_acquire); r; r = r->next) {
+        bool expected = false;
+        if (!r->used.load(std::memory_order_relaxed) && r->used.compare_exchange_strong(expected, true)) {
+            record = r;
+            break;
+        }
+    }
+    if (!record) {
+        record = new EpochRecord;
+        record->used = true;
+        EpochRecord *head = state.records.load(std::memory_order_relaxed);
+        do {
+            record->next = head;
+        } while (!state.records.compare_exchange_weak(head, record, std::memory_order_release,
+                                                      std::memory_order_relaxed));
+    }
+    t_releaser.record = record;
+    return record;
+}
+
+void Epoch::Enter() {
+    if (t_depth++ > 0) {
+        return;
+    }
+    if (RPC_UNLIKELY(!t_record)) {
+        t_record = AcquireRecord();
+    }
+    t_record->epoch.store(GetState().epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // 公开记录之后才读取共享结构, 与Retire中的fence配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Epoch::Leave() {
+    if (--t_depth > 0) {
+        return;
+    }
+    t_record->epoch.store(0, std::memory_order_release);
+}
+
+void Epoch::Retire(std::shared_ptr<void> obj) {
+    EpochState &state = GetState();
+    std::vector<RetiredObject> freed;
+    {
+        Mutex::Lock lock(state.mutex);
+        // 对象已经摘除, epoch增加之后进入临界区的读者一定读不到它
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t epoch = state.epoch.fetch_add(1, std::memory_order_seq_cst);
+        if (obj) {
+            state.retired.push_back(RetiredObject{epoch, std::move(obj)});
+        }
+        uint64_t min_epoch = ~0ull;
+        for (EpochRecord *r = state.records.load(std::memory_order_acquire); r; r = r->next) {
+            uint64_t e = r->epoch.load(std::memory_order_acquire);
+            if (e != 0 && e < min_epoch) {
+                min_epoch = e;
+            }
+        }
+        // 所有读者都是在摘除之后进入的临界区, 对象可以释放
+        auto it = std::partition(state.retired.begin(), state.retired.end(),
+                                 [min_epoch](const RetiredObject &r) { return r.epoch >= min_epoch; });
+        std::move(it, state.retired.end(), std::back_inserter(freed));
+        state.retired.erase(it, state.retired.end());
+    }
+    // 对象在锁外析构
+}
+
+}
@@ -67,37 +67,68 @@ uint64_t FdContext::getTimeout(int type) {
 
 
 FdManager::FdManager() {
-    fdContextList_.resize(64);
+    for (auto &chunk : chunks_) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
 }
 
 FdManager::~FdManager() {
-
+    for (auto &chunk : chunks_) {
+        delete chunk.load(std::memory_order_relaxed);
+    }
 }
 
 FdContext::ptr FdManager::getFdContext(int fd, bool auto_create) {
-    RWMutexType::ReadLock lock(mutex_);
-    if ((int)fdContextList_.size() <= fd) {
-        if (!auto_create) {
-            return nullptr;
+    if ((unsigned)fd >= MAX_FDS) {
+        return nullptr;
+    }
+    {
+        Epoch::Guard guard;
+        FdContext *fdctx = lookup(fd);
+        if (fdctx) {
+            // 删除后的上下文在临界区内不会释放, 引用计数不为0
+            return fdctx->shared_from_this();
         }
-    } else {
-        if (fdContextList_[fd] || !auto_create) {
-            return fdContextList_[fd];
+    }
+    if (!auto_create) {
+        return nullptr;
+    }
+    MutexType::Lock lock(mutex_);
+    Chunk *chunk = chunks_[fd >> CHUNK_BITS].load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new Chunk;
+        for (auto &context : chunk->contexts) {
+            context.store(nullptr, std::memory_order_relaxed);
         }
+        chunks_[fd >> CHUNK_BITS].store(chunk, std::memory_order_release);
     }
-    lock.unlock();
-    RWMutexType::WriteLock lock1(mutex_);
-    FdContext::ptr new_fdContext(new FdContext(fd));
-    fdContextList_[fd] = new_fdContext;
-    return new_fdContext;
+    unsigned index = fd & (CHUNK_SIZE - 1);
+    if (!chunk->owners[index]) {
+        chunk->owners[index].reset(new FdContext(fd));
+        chunk->contexts[index].store(chunk->owners[index].get(), std::memory_order_release);
+    }
+    return chunk->owners[index];
 }
 
 void FdManager::delFdContext(int fd) {
-    RWMutexType::WriteLock lock(mutex_);
-    if ((int)fdContextList_.size() <= fd) {
+    if ((unsigned)fd >= MAX_FDS) {
+        return;
+    }
+    MutexType::Lock lock(mutex_);
+    Chunk *chunk = chunks_[fd >> CHUNK_BITS].load(std::memory_order_relaxed);
+    if (!chunk) {
         return;
     }
-    fdContextList_[fd].reset();
+    unsigned index = fd & (CHUNK_SIZE - 1);
+    if (!chunk->owners[index]) {
+        return;
+    }
+    chunk->contexts[index].store(nullptr, std::memory_order_release);
+    FdContext::ptr fdctx;
+    fdctx.swap(chunk->owners[index]);
+    lock.unlock();
+    // 无锁查找的读者可能还在使用, 等它们离开临界区后再释放
+    Epoch::Retire(std::move(fdctx));
 }
 
 }
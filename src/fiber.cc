@@ -1,12 +1,17 @@
 #include "fiber.h"
 #include "macro.h"
+#include "utils.h"
 #include <assert.h>
 #include <atomic>
 #include <exception>
+#include <string.h>
+#include <stdlib.h>
 namespace RPC {
 static Logger::ptr logger = RPC_LOG_ROOT();
 static std::atomic<uint64_t> s_fiber_count{0};
 static std::atomic<uint64_t> s_fiber_id{0};
+// 共享栈协程保存栈内容占用的内存
+static std::atomic<uint64_t> s_shared_saved_bytes{0};
 
 // 主协程指针
 static thread_local Fiber::ptr t_thread_fiber = nullptr;
@@ -14,16 +19,21 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 static thread_local Fiber *t_fiber = nullptr;
 
 
-Fiber::Fiber() {
+Fiber::Fiber()
+    :id_(0),
+    stack_size_(0),
+    stack_(nullptr),
+    sharedStack_(false),
+    thread_(-1),
+    saveBuffer_(nullptr),
+    saveSize_(0),
+    saveCapacity_(0) {
     /**
      * @brief 主协程构造函数
      * 
      */
     state_ = EXEC;
     SetThis(this);
-    if (getcontext(&ctx_) < 0) {
-        RPC_ASSERT2(false, "System error: getcontext fail");
-    }
 
     s_fiber_count++;
     RPC_LOG_DEBUG(logger) << "Fiber::Fiber main";
@@ -34,31 +44,42 @@ Fiber::Fiber() {
 
 
 
-Fiber::Fiber(std::function<void()> func, size_t stack_size)
+Fiber::Fiber(std::function<void()> func, size_t stack_size, bool shared_stack)
     :id_(++s_fiber_id), 
     stack_size_(stack_size),
     stack_(nullptr), 
     state_(INIT), 
-    func_(func) {
+    func_(func),
+    sharedStack_(shared_stack),
+    thread_(-1),
+    saveBuffer_(nullptr),
+    saveSize_(0),
+    saveCapacity_(0) {
     /**
      * @brief 非主协程构造函数，非主协程必须由主协程构造, 创建后不会立刻调度
      * 
      */
     RPC_ASSERT2(t_fiber, "Fiber error: no main fiber")
     RPC_ASSERT2(stack_size > 0, "System error: stack size error")
-    stack_ = malloc(stack_size);
+#ifdef RPC_FIBER_UCONTEXT
+    // ucontext实现拿不到切出时的栈顶, 无法只拷贝已使用的部分
+    sharedStack_ = false;
+#endif
     s_fiber_count++;
+    if (sharedStack_) {
+        // 共享栈在第一次执行时才绑定, 上下文在acquireSharedStack中构造
+        RPC_LOG_DEBUG(logger) << "Fiber::Fiber id=" << id_ << " shared stack";
+        return;
+    }
+    // 从栈池中分配, 实际大小向上取整到栈池规格
+    size_t real_size = stack_size;
+    stack_ = FiberStackPool::Alloc(real_size);
+    RPC_ASSERT2(stack_, "System error: alloc fiber stack fail")
+    stack_size_ = real_size;
     // SetThis(this);
-    if (getcontext(&ctx_) < 0) {
-        RPC_ASSERT2(false, "System error: getcontext fail");
+    if (!ctx_.make(stack_, stack_size_, MainFunc)) {
+        RPC_ASSERT2(false, "System error: make fiber context fail");
     }
-    // 下一context
-    ctx_.uc_link = nullptr;
-    //运行栈信息
-    ctx_.uc_stack.ss_size = stack_size_;
-    ctx_.uc_stack.ss_sp = stack_;
-
-    makecontext(&ctx_, MainFunc, 0);
 
 
    RPC_LOG_DEBUG(logger) << "Fiber::Fiber id=" << id_;
@@ -66,10 +87,18 @@ Fiber::Fiber(std::function<void()> func, size_t stack_size)
 }
 Fiber::~Fiber() {
     --s_fiber_count;
-    if (stack_) {
+    if (sharedStack_) {
+        // 共享栈协程退出
+        RPC_ASSERT(state_ == INIT || state_ == TERM || state_ == EXCEPT);
+        if (shared_ && shared_->getOwner() == this) {
+            shared_->setOwner(nullptr);
+        }
+        s_shared_saved_bytes -= saveCapacity_;
+        free(saveBuffer_);
+    } else if (stack_) {
         // 非主协程退出
         RPC_ASSERT(state_ == INIT || state_ == TERM || state_ == EXCEPT);
-        free(stack_);
+        FiberStackPool::Free(stack_, stack_size_);
     } else {
         // 主协程退出
         RPC_ASSERT(state_==EXEC);
@@ -93,10 +122,62 @@ void Fiber::SetThis(Fiber *fiber) {
 void Fiber::Resume() {
     SetThis(this);
     RPC_ASSERT2(state_ != EXEC, "fiber id =" + std::to_string(id_));
+    // 协程设置HOLD后可能在其他线程被唤醒, 此时原线程可能还没有完成切出
+    while (running_.exchange(true, std::memory_order_acquire)) {
+        CpuRelax();
+    }
+    if (sharedStack_) {
+        acquireSharedStack();
+    }
     state_ = EXEC;
-    if (swapcontext(&t_thread_fiber->ctx_, &ctx_) < 0) {
+    if (!FiberContext::swap(t_thread_fiber->ctx_, ctx_)) {
         RPC_ASSERT2(false, "System error : swap fiber erro");
     }
+    if (sharedStack_ && isTerminate() && shared_->getOwner() == this) {
+        // 已经结束的协程不需要保存栈内容
+        shared_->setOwner(nullptr);
+    }
+    running_.store(false, std::memory_order_release);
+}
+
+void Fiber::acquireSharedStack() {
+    if (!shared_) {
+        shared_ = SharedStack::GetThis();
+        thread_ = GetThreadId();
+        stack_ = shared_->getStack();
+        stack_size_ = shared_->getSize();
+        if (!ctx_.make(stack_, stack_size_, MainFunc)) {
+            RPC_ASSERT2(false, "System error: make fiber context fail");
+        }
+    }
+    RPC_ASSERT2(thread_ == GetThreadId(), "shared stack fiber id=" + std::to_string(id_)
+                    + " must resume on thread " + std::to_string(thread_));
+    Fiber *owner = shared_->getOwner();
+    if (owner == this) {
+        return;
+    }
+    if (owner) {
+        owner->saveSharedStack();
+    }
+    if (saveSize_) {
+        memcpy(shared_->getTop() - saveSize_, saveBuffer_, saveSize_);
+    }
+    shared_->setOwner(this);
+}
+
+void Fiber::saveSharedStack() {
+    char *sp = (char *)ctx_.getStackPointer();
+    RPC_ASSERT(sp);
+    size_t used = shared_->getTop() - sp;
+    if (used > saveCapacity_) {
+        char *buffer = (char *)realloc(saveBuffer_, used);
+        RPC_ASSERT2(buffer, "System error: alloc shared stack buffer fail");
+        s_shared_saved_bytes += used - saveCapacity_;
+        saveBuffer_ = buffer;
+        saveCapacity_ = used;
+    }
+    memcpy(saveBuffer_, sp, used);
+    saveSize_ = used;
 }
 
 /**
@@ -105,22 +186,24 @@ void Fiber::Resume() {
  */
 void Fiber::Yield() {
     SetThis(t_thread_fiber.get());
-    if (swapcontext(&ctx_, &t_thread_fiber->ctx_) < 0) {
+    if (!FiberContext::swap(ctx_, t_thread_fiber->ctx_)) {
         RPC_ASSERT2(false, "System error: swap fiber error")
     }
 }
 
 void Fiber::Reset(std::function<void()> func) {
-    RPC_ASSERT(stack_);
+    RPC_ASSERT(stack_ || sharedStack_);
     RPC_ASSERT(state_ == INIT || state_ == TERM || state_ == EXCEPT);
     func_ = func;
-    if (getcontext(&ctx_) < 0) {
-        RPC_ASSERT2(false, "System error: getcontext fail");
+    if (sharedStack_) {
+        saveSize_ = 0;
+        if (shared_ && shared_->getOwner() == this) {
+            shared_->setOwner(nullptr);
+        }
+    }
+    if (stack_ && !ctx_.make(stack_, stack_size_, MainFunc)) {
+        RPC_ASSERT2(false, "System error: make fiber context fail");
     }
-    ctx_.uc_link = nullptr;
-    ctx_.uc_stack.ss_size = stack_size_;
-    ctx_.uc_stack.ss_sp = stack_;
-    makecontext(&ctx_, MainFunc, 0);
     state_ = INIT;
 }
 Fiber::ptr Fiber::GetThis() {
@@ -170,6 +253,10 @@ void Fiber::EnableFiber() {
 }
 
 
+uint64_t Fiber::GetSharedStackSavedBytes() {
+    return s_shared_saved_bytes;
+}
+
 uint64_t Fiber::GetFiberId() {
     if(t_fiber) {
         return t_fiber->GetId();
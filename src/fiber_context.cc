@@ -0,0 +1,126 @@
+#include "fiber_context.h"
+#include <string.h>
+
+#ifndef RPC_FIBER_UCONTEXT
+#if defined(__x86_64__)
+/**
+ * 栈上保存的布局(低地址 -> 高地址):
+ *  mxcsr(4字节) + x87控制字(4字节), r15, r14, r13, r12, rbx, rbp, 返回地址
+ */
+asm(R"(
+    .pushsection .text
+    .globl rpc_fiber_swap_context
+    .type rpc_fiber_swap_context, @function
+    .align 16
+rpc_fiber_swap_context:
+    pushq %rbp
+    pushq %rbx
+    pushq %r12
+    pushq %r13
+    pushq %r14
+    pushq %r15
+    subq $8, %rsp
+    stmxcsr (%rsp)
+    fnstcw 4(%rsp)
+    movq %rsp, (%rdi)
+    movq %rsi, %rsp
+    ldmxcsr (%rsp)
+    fldcw 4(%rsp)
+    addq $8, %rsp
+    popq %r15
+    popq %r14
+    popq %r13
+    popq %r12
+    popq %rbx
+    popq %rbp
+    ret
+    .size rpc_fiber_swap_context, .-rpc_fiber_swap_context
+    .popsection
+)");
+#elif defined(__aarch64__)
+/**
+ * 栈上保存的布局(低地址 -> 高地址):
+ *  x19-x28, x29(fp), x30(lr), d8-d15
+ */
+asm(R"(
+    .pushsection .text
+    .globl rpc_fiber_swap_context
+    .type rpc_fiber_swap_context, %function
+    .align 4
+rpc_fiber_swap_context:
+    sub sp, sp, #160
+    stp x19, x20, [sp, #0]
+    stp x21, x22, [sp, #16]
+    stp x23, x24, [sp, #32]
+    stp x25, x26, [sp, #48]
+    stp x27, x28, [sp, #64]
+    stp x29, x30, [sp, #80]
+    stp d8, d9, [sp, #96]
+    stp d10, d11, [sp, #112]
+    stp d12, d13, [sp, #128]
+    stp d14, d15, [sp, #144]
+    mov x9, sp
+    str x9, [x0]
+    mov sp, x1
+    ldp x19, x20, [sp, #0]
+    ldp x21, x22, [sp, #16]
+    ldp x23, x24, [sp, #32]
+    ldp x25, x26, [sp, #48]
+    ldp x27, x28, [sp, #64]
+    ldp x29, x30, [sp, #80]
+    ldp d8, d9, [sp, #96]
+    ldp d10, d11, [sp, #112]
+    ldp d12, d13, [sp, #128]
+    ldp d14, d15, [sp, #144]
+    add sp, sp, #160
+    ret
+    .size rpc_fiber_swap_context, .-rpc_fiber_swap_context
+    .popsection
+)");
+#endif
+#endif
+
+namespace RPC {
+
+bool FiberContext::make(void *stack, size_t size, EntryFunc entry) {
+#ifdef RPC_FIBER_UCONTEXT
+    if (getcontext(&ctx_) < 0) {
+        return false;
+    }
+    ctx_.uc_link = nullptr;
+    ctx_.uc_stack.ss_sp = stack;
+    ctx_.uc_stack.ss_size = size;
+    makecontext(&ctx_, entry, 0);
+    return true;
+#else
+    // 栈顶16字节对齐
+    uintptr_t top = ((uintptr_t)stack + size) & ~(uintptr_t)15;
+#if defined(__x86_64__)
+    // 进入entry时 rsp + 8 需要16字节对齐, 与call指令压入返回地址后的状态一致
+    void **sp = (void **)(top - 72);
+    memset(sp, 0, 72);
+    uint32_t *fpu = (uint32_t *)sp;
+    fpu[0] = 0x1F80;  // mxcsr 默认值
+    fpu[1] = 0x037F;  // x87 控制字默认值
+    sp[7] = (void *)entry;
+#elif defined(__aarch64__)
+    void **sp = (void **)(top - 160);
+    memset(sp, 0, 160);
+    sp[11] = (void *)entry;  // x30(lr), ret 跳转到entry
+#endif
+    sp_ = sp;
+    return true;
+#endif
+}
+
+const char* FiberContext::Backend() {
+#if defined(RPC_FIBER_UCONTEXT)
+    return "ucontext";
+#elif defined(__x86_64__)
+    return "x86_64-asm";
+#else
+    return "aarch64-asm";
+#endif
+}
+
+}
@@ -0,0 +1,176 @@
+#include "fiber_stack.h"
+#include "log.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <string.h>
+#include <atomic>
+namespace RPC {
+static Logger::ptr logger = RPC_LOG_ROOT();
+/* 最小的栈规格 16KiB, 规格依次翻倍到 1MiB */
+static const size_t s_min_stack_size = 16 * 1024;
+/* 每种规格最多缓存的栈数量 */
+static const size_t s_stack_cache_max = 64;
+/* 每种规格保持常驻的缓存栈数量, 其余的缓存栈会被madvise */
+static const size_t s_stack_cache_hot = 8;
+
+static std::atomic<uint64_t> s_hits{0};
+static std::atomic<uint64_t> s_misses{0};
+static std::atomic<uint64_t> s_in_use{0};
+static std::atomic<uint64_t> s_cached{0};
+static std::atomic<uint64_t> s_mapped_bytes{0};
+static std::atomic<uint64_t> s_resident_bytes{0};
+
+/* 每个线程共享栈的大小 */
+static const size_t s_shared_stack_size = 128 * 1024;
+
+/* 线程退出时栈池已经析构, 之后归还的栈直接munmap */
+static thread_local bool t_pool_destroyed = false;
+
+static size_t PageSize() {
+    static size_t page_size = sysconf(_SC_PAGESIZE);
+    return page_size;
+}
+
+FiberStackPool::~FiberStackPool() {
+    t_pool_destroyed = true;
+    for (int i = 0; i < kClassCount; ++i) {
+        size_t size = s_min_stack_size << i;
+        for (auto &entry : cache_[i]) {
+            if (entry.resident) {
+                s_resident_bytes -= size;
+            }
+            s_mapped_bytes -= size;
+            --s_cached;
+            Unmap(entry.stack, size);
+        }
+        cache_[i].clear();
+    }
+}
+
+FiberStackPool* FiberStackPool::GetThis() {
+    if (t_pool_destroyed) {
+        return nullptr;
+    }
+    static thread_local FiberStackPool pool;
+    return &pool;
+}
+
+int FiberStackPool::SizeClass(size_t size) {
+    int cls = 0;
+    while (cls < kClassCount && (s_min_stack_size << cls) < size) {
+        ++cls;
+    }
+    return cls < kClassCount ? cls : -1;
+}
+
+void* FiberStackPool::Map(size_t size) {
+    size_t page = PageSize();
+    void *addr = mmap(nullptr, size + page, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+    if (addr == MAP_FAILED) {
+        RPC_LOG_ERROR(logger) << "FiberStackPool mmap fail, size=" << size
+            << " errno=" << errno << " errstr=" << strerror(errno);
+        return nullptr;
+    }
+    // 栈向低地址增长, 最低的一页作为守护页
+    if (mprotect(addr, page, PROT_NONE) != 0) {
+        RPC_LOG_ERROR(logger) << "FiberStackPool mprotect guard page fail, errno=" << errno
+            << " errstr=" << strerror(errno);
+        munmap(addr, size + page);
+        return nullptr;
+    }
+    return (char *)addr + page;
+}
+
+void FiberStackPool::Unmap(void *stack, size_t size) {
+    size_t page = PageSize();
+    munmap((char *)stack - page, size + page);
+}
+
+void* FiberStackPool::Alloc(size_t &size) {
+    int cls = SizeClass(size);
+    if (cls >= 0) {
+        size = s_min_stack_size << cls;
+        FiberStackPool *pool = GetThis();
+        if (pool && !pool->cache_[cls].empty()) {
+            CacheEntry entry = pool->cache_[cls].back();
+            pool->cache_[cls].pop_back();
+            ++s_hits;
+            --s_cached;
+            ++s_in_use;
+            if (!entry.resident) {
+                s_resident_bytes += size;
+            }
+            return entry.stack;
+        }
+    } else {
+        size_t page = PageSize();
+        size = (size + page - 1) / page * page;
+    }
+    void *stack = Map(size);
+    if (!stack) {
+        return nullptr;
+    }
+    ++s_misses;
+    ++s_in_use;
+    s_mapped_bytes += size;
+    s_resident_bytes += size;
+    return stack;
+}
+
+void FiberStackPool::Free(void *stack, size_t size) {
+    if (!stack) {
+        return;
+    }
+    --s_in_use;
+    int cls = SizeClass(size);
+    FiberStackPool *pool = GetThis();
+    if (cls < 0 || !pool || (s_min_stack_size << cls) != size
+            || pool->cache_[cls].size() >= s_stack_cache_max) {
+        s_resident_bytes -= size;
+        s_mapped_bytes -= size;
+        Unmap(stack, size);
+        return;
+    }
+    std::vector<CacheEntry> &cache = pool->cache_[cls];
+    cache.push_back({stack, true});
+    ++s_cached;
+    // 后进先出, 超出热缓存窗口的栈归还物理内存
+    if (cache.size() > s_stack_cache_hot) {
+        CacheEntry &cold = cache[cache.size() - 1 - s_stack_cache_hot];
+        if (cold.resident) {
+            madvise(cold.stack, size, MADV_DONTNEED);
+            cold.resident = false;
+            s_resident_bytes -= size;
+        }
+    }
+}
+
+FiberStackPool::Stat FiberStackPool::GetStat() {
+    Stat stat;
+    stat.hits = s_hits;
+    stat.misses = s_misses;
+    stat.inUse = s_in_use;
+    stat.cached = s_cached;
+    stat.mappedBytes = s_mapped_bytes;
+    stat.residentBytes = s_resident_bytes;
+    return stat;
+}
+
+SharedStack::SharedStack(size_t size):stack_(nullptr), size_(size), owner_(nullptr) {
+    stack_ = FiberStackPool::Alloc(size_);
+}
+
+SharedStack::~SharedStack() {
+    FiberStackPool::Free(stack_, size_);
+}
+
+SharedStack::ptr SharedStack::GetThis() {
+    static thread_local SharedStack::ptr t_shared_stack;
+    if (!t_shared_stack) {
+        t_shared_stack = std::make_shared<SharedStack>(s_shared_stack_size);
+    }
+    return t_shared_stack;
+}
+
+}
@@ -3,13 +3,20 @@
 #include "fiber.h"
 #include "io_manager.h"
 #include "fd_manager.h"
+#include "offload.h"
 #include "macro.h"
 #include <dlfcn.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <sys/sendfile.h>
 #include <fcntl.h>
 #include <stdarg.h>
 #include <sys/ioctl.h>
+#include <linux/io_uring.h>
+#include <algorithm>
+#include <unordered_set>
 static RPC::Logger::ptr logger = RPC_LOG_ROOT();
 namespace RPC {
 
@@ -35,7 +42,14 @@ static thread_local bool t_hook_enable = false;
     XX(fcntl) \
     XX(ioctl) \
     XX(getsockopt) \
-    XX(setsockopt)
+    XX(setsockopt) \
+    XX(poll) \
+    XX(select) \
+    XX(epoll_wait) \
+    XX(accept4) \
+    XX(pread) \
+    XX(pwrite) \
+    XX(sendfile)
 
 /**
  * @brief 把所有需要hook的系统函数hook上
@@ -69,35 +83,72 @@ void set_hook_enable(bool flag) {
 
 }
 
+/**
+ * @brief 构造直接提交给io_uring的请求
+ */
+static RPC::IOManager::IoRequest make_io_request(uint8_t opcode, int fd, const void *addr, uint32_t len,
+                                                 uint64_t off = 0, uint32_t flags = 0) {
+    RPC::IOManager::IoRequest req;
+    req.opcode = opcode;
+    req.fd = fd;
+    req.addr = (uint64_t)addr;
+    req.len = len;
+    req.off = off;
+    req.flags = flags;
+    return req;
+}
+
+/**
+ * @brief 把iovec包装成只有数据的msghdr, readv/writev在socket上以RECVMSG/SENDMSG提交
+ *  submitIo返回前协程一直挂起, msghdr放在调用者的栈上即可
+ */
+static struct msghdr make_iov_msghdr(const struct iovec *iov, int iovcnt) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec*>(iov);
+    msg.msg_iovlen = iovcnt;
+    return msg;
+}
+
+static int do_poll(struct pollfd *fds, nfds_t nfds, uint64_t timeout_us);
+
+/**
+ * @param req 数据未就绪时提交给io_uring的等价请求, 为空或io_uring不可用时使用epoll等待后重试
+ */
 template<typename OriginFun, typename...Args>
-static ssize_t do_io(int fd, RPC::IOManager::Event event, const char *fun_name, OriginFun fun, Args&&...args) {
+static ssize_t do_io(int fd, RPC::IOManager::Event event, const char *fun_name,
+                     const RPC::IOManager::IoRequest *req, OriginFun fun, Args&&...args) {
     if (!RPC::is_enable_hook()) {
         return fun(fd, std::forward<Args>(args)...);
     }
-    RPC::FdContext::ptr fdctx = RPC::FdMgr::GetInstance()->getFdContext(fd);
-    if (!fdctx) {
-        // 不存在fd上下文(不是socket)
-        return fun(fd, std::forward<Args>(args)...);
+    bool closed = false;
+    bool hooked = false;
+    uint64_t timeout = 0;
+    {
+        // 无锁查看fd上下文, 不增加引用计数, 临界区内不调用原始io函数
+        RPC::Epoch::Guard guard;
+        RPC::FdContext *ctx = RPC::FdMgr::GetInstance()->lookup(fd);
+        if (ctx) {
+            closed = ctx->isClosed();
+            // 只处理socket和系统级阻塞的情况
+            hooked = ctx->isSocket() && !ctx->userNonblock();
+            // 获取超时时间(微秒)
+            timeout = ctx->getTimeout(event == RPC::IOManager::READ ? SO_RCVTIMEO : SO_SNDTIMEO);
+        }
     }
-    if (fdctx->isClosed()) {
+    if (closed) {
         // fd 已经关闭
         /* Bad file number */
         errno = EBADF;
         return -1;
     }
-    if (!fdctx->isSocket() || fdctx->userNonblock()) {
-        // 只处理socket和系统级阻塞的情况
+    if (!hooked) {
+        // 不存在fd上下文(不是socket)或用户级非阻塞
         return fun(fd, std::forward<Args>(args)...);
     }
-
-    // 获取超时时间
-    uint64_t timeout = 0;
-    std::shared_ptr<int> timecondition(new int{0});
-    if (event == RPC::IOManager::READ) {
-        timeout = fdctx->getTimeout(SO_RCVTIMEO);
-    } else {
-        timeout = fdctx->getTimeout(SO_SNDTIMEO);
-    }
+    // 需要挂起协程时才持有fd上下文的引用
+    RPC::FdContext::ptr fdctx;
+    std::shared_ptr<int> timecondition;
 retry:
     // 调用原始io函数
     ssize_t n = fun(fd, std::forward<Args>(args)...);
@@ -107,13 +158,61 @@ retry:
     }
     if (n == -1 && errno == EAGAIN) {
         // 数据没准备好 挂起协程
+        if (!fdctx) {
+            fdctx = RPC::FdMgr::GetInstance()->getFdContext(fd);
+            if (!fdctx) {
+                // 已经被其他协程关闭
+                errno = EBADF;
+                return -1;
+            }
+            timecondition.reset(new int{0});
+        }
         RPC::IOManager* iomanager = RPC::IOManager::GetThis();
+        int res = 0;
+        if (req && iomanager->submitIo(*req, timeout, res)) {
+            // io_uring完成时请求已经执行完, 不需要再调用原始io函数
+            if (res >= 0) {
+                return res;
+            }
+            if (res != -EAGAIN) {
+                if (res == -ECANCELED) {
+                    // 被链接的超时请求或关闭句柄取消
+                    bool closed = RPC::FdMgr::GetInstance()->getFdContext(fd) != fdctx;
+                    res = closed ? -EBADF : -ETIMEDOUT;
+                }
+                errno = -res;
+                return -1;
+            }
+            // 旧内核对非阻塞socket直接返回EAGAIN, 退回epoll等待
+        }
+        RPC::IOManager::AddEventResult rt = iomanager->tryAddEvent(fd, event);
+        if (rt == RPC::IOManager::ADD_READY) {
+            // 常驻注册记录的边沿在上次等待之后已经到达, 直接重试, 不切出协程
+            goto retry;
+        }
+        if (rt == RPC::IOManager::ADD_BUSY) {
+            // 其他协程(如poll)在等待同一方向, 不能注册, 交给poll定时检查
+            pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = event == RPC::IOManager::READ ? POLLIN : POLLOUT;
+            pfd.revents = 0;
+            if (do_poll(&pfd, 1, timeout) == 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            goto retry;
+        }
+        if (rt == RPC::IOManager::ADD_ERROR) {
+            /* 添加事件失败*/
+            RPC_LOG_ERROR(logger) << "do_io add event error";
+            return -1;
+        }
         std::weak_ptr<int> weak_cond(timecondition);
         RPC::Timer::ptr timer;
         if (timeout != (uint64_t)-1) {
-            // 有设置超时时间
+            // 有设置超时时间, 事件注册之后再添加定时器, 协程切出之前定时器触发也能取消事件
             /* 过了超时时间，weak_cond指针所指对象仍然存在，触发回调函数 */
-            timer = iomanager->addConditionTimer(timeout, [weak_cond, iomanager, fd, event]() {
+            timer = iomanager->addConditionTimerUS(timeout, [weak_cond, iomanager, fd, event]() {
                 auto t = weak_cond.lock();
                 if (!t || *t) {
                     // 条件已经不成立
@@ -124,15 +223,6 @@ retry:
                 iomanager->cancelEvent(fd, event);
             }, weak_cond);
         }
-        bool rt = iomanager->addEvent(fd, event);
-        if (!rt) {
-            /* 添加事件失败*/
-            RPC_LOG_ERROR(logger) << "do_io add event error";
-            if (timer) {
-                timer->cancel();
-            }
-            return -1;
-        }
         RPC::Fiber::YieldToHold();
         // 数据已经准备好 
         if (timer) {
@@ -148,6 +238,140 @@ retry:
     return n;
 }
 
+/**
+ * @brief poll挂起的协程, 任一事件或超时定时器触发时唤醒一次
+ */
+struct PollWaiter {
+    std::atomic<bool> woken{false};
+    RPC::Fiber::ptr fiber;
+    RPC::IOManager *iomanager = nullptr;
+    // 每个注册的事件是否已经触发, 触发后事件已经从IOManager中移除
+    std::unique_ptr<std::atomic<bool>[]> fired;
+    void wake(size_t index) {
+        fired[index] = true;
+        wake();
+    }
+    void wake() {
+        if (!woken.exchange(true)) {
+            iomanager->Submit(fiber);
+        }
+    }
+};
+
+// 有事件无法靠IOManager唤醒时重新调用原始poll的间隔(微秒)
+static const uint64_t s_poll_recheck_us = 10 * 1000;
+
+/**
+ * @param timeout_us 超时时间(微秒), -1表示不超时
+ *  先以0超时调用原始poll, 没有就绪的句柄时把关心的可读可写事件注册到IOManager并挂起协程,
+ *  被唤醒后移除其余的事件, 再次调用原始poll得到结果.
+ *  同一个句柄的同一方向只注册一次. POLLPRI等事件、已有其他协程等待的方向和注册失败的句柄
+ *  不能唤醒协程, 此时每隔s_poll_recheck_us重新检查一次, 不会在没有唤醒者的情况下挂起
+ */
+static int do_poll(struct pollfd *fds, nfds_t nfds, uint64_t timeout_us) {
+    RPC::IOManager *iomanager = RPC::IOManager::GetThis();
+    if (!RPC::is_enable_hook() || !iomanager || timeout_us == 0) {
+        return poll_f(fds, nfds, timeout_us == (uint64_t)-1 ? -1 : (int)((timeout_us + 999) / 1000));
+    }
+    uint64_t deadline = timeout_us == (uint64_t)-1 ? timeout_us : RPC::GetMonotonicUS() + timeout_us;
+    while (true) {
+        int n = poll_f(fds, nfds, 0);
+        if (n != 0) {
+            return n;
+        }
+        uint64_t now = RPC::GetMonotonicUS();
+        if (deadline != (uint64_t)-1 && now >= deadline) {
+            return 0;
+        }
+        std::shared_ptr<PollWaiter> waiter(new PollWaiter);
+        waiter->fiber = RPC::Fiber::GetThis();
+        waiter->iomanager = iomanager;
+        waiter->fired.reset(new std::atomic<bool>[nfds * 2]());
+        std::vector<std::pair<int, RPC::IOManager::Event>> registered;
+        // 已经处理过的(句柄, 事件), 同一个句柄在数组中出现多次时只注册一次
+        std::unordered_set<uint64_t> seen;
+        bool recheck = false;
+        bool ready = false;
+        for (nfds_t i = 0; i < nfds && !ready; ++i) {
+            if (fds[i].fd < 0) {
+                continue;
+            }
+            if (fds[i].events & ~(POLLIN | POLLRDNORM | POLLOUT | POLLWRNORM)) {
+                // POLLPRI等事件没有对应的IOManager事件
+                recheck = true;
+            }
+            short want[2] = {POLLIN | POLLRDNORM, POLLOUT | POLLWRNORM};
+            RPC::IOManager::Event events[2] = {RPC::IOManager::READ, RPC::IOManager::WRITE};
+            for (int k = 0; k < 2; ++k) {
+                if (!(fds[i].events & want[k])
+                        || !seen.insert((uint64_t)(uint32_t)fds[i].fd << 32 | events[k]).second) {
+                    continue;
+                }
+                size_t index = registered.size();
+                RPC::IOManager::AddEventResult rt = iomanager->tryAddEvent(fds[i].fd, events[k],
+                        [waiter, index]() { waiter->wake(index); }, waiter.get());
+                if (rt == RPC::IOManager::ADD_OK) {
+                    registered.push_back(std::make_pair(fds[i].fd, events[k]));
+                } else if (rt == RPC::IOManager::ADD_READY) {
+                    // 常驻注册记录的边沿已经到达, 不挂起直接重新检查
+                    ready = true;
+                    break;
+                } else {
+                    // 已有其他协程在等待该方向或者注册失败
+                    recheck = true;
+                }
+            }
+        }
+        RPC::Timer::ptr timer;
+        if (!ready) {
+            uint64_t wait_us = deadline == (uint64_t)-1 ? deadline : deadline - now;
+            if (recheck || registered.empty()) {
+                wait_us = std::min(wait_us, s_poll_recheck_us);
+            }
+            if (wait_us != (uint64_t)-1) {
+                timer = iomanager->addTimerUS(wait_us, [waiter]() { waiter->wake(); });
+            }
+            RPC::Fiber::YieldToHold();
+        }
+        if (timer) {
+            timer->cancel();
+        }
+        for (size_t i = 0; i < registered.size(); ++i) {
+            if (!waiter->fired[i]) {
+                // 只移除自己的注册, 触发后被其他协程重新注册的事件不受影响
+                iomanager->removeEvent(registered[i].first, registered[i].second, waiter.get());
+            }
+        }
+    }
+}
+
+/**
+ * @brief 普通文件的pread/pwrite, 先以RWF_NOWAIT尝试, 数据不在页缓存中(或内核不支持)时交给阻塞线程池
+ */
+template<typename NowaitFun, typename OriginFun, typename Buf>
+static ssize_t do_file_io(NowaitFun nowait_fun, OriginFun fun, int fd, Buf buf, size_t count, off_t offset) {
+    if (!RPC::is_enable_hook()) {
+        return fun(fd, buf, count, offset);
+    }
+#ifdef RWF_NOWAIT
+    struct iovec iov;
+    iov.iov_base = (void *)buf;
+    iov.iov_len = count;
+    ssize_t n = nowait_fun(fd, &iov, 1, offset, RWF_NOWAIT);
+    if (n >= 0 || (errno != EAGAIN && errno != EOPNOTSUPP && errno != EINVAL && errno != ENOSYS)) {
+        return n;
+    }
+#endif
+    ssize_t rt = -1;
+    int error = 0;
+    RPC::OffloadPool::GetDefault()->run([&]() {
+        rt = fun(fd, buf, count, offset);
+        error = errno;
+    });
+    errno = error;
+    return rt;
+}
+
 extern "C" {
 #define XX(name) name ## _fun name ## _f = nullptr;
     HOOK_FUN(XX)
@@ -174,7 +398,7 @@ int usleep(useconds_t usec) {
     RPC::IOManager* iomanger = RPC::IOManager::GetThis();
     RPC::Fiber::ptr fiber = RPC::Fiber::GetThis();
     RPC_ASSERT2(iomanger, "iomanager is not start");
-    iomanger->addTimer(usec /1000, [iomanger, fiber]() mutable {
+    iomanger->addTimerUS(usec, [iomanger, fiber]() mutable {
         iomanger->Submit(fiber, -1);
     });
     RPC::Fiber::YieldToHold();
@@ -188,14 +412,29 @@ int nanosleep(const struct timespec *req, struct timespec *rem) {
     RPC::IOManager* iomanager = RPC::IOManager::GetThis();
     RPC::Fiber::ptr fiber = RPC::Fiber::GetThis();
     RPC_ASSERT2(iomanager, "iomanger is not start");
-    int time_ms = req->tv_sec * 1000 + req->tv_nsec/1000 / 1000;
-    iomanager->addTimer(time_ms, [iomanager, fiber]() mutable {
+    uint64_t time_us = req->tv_sec * 1000000ull + req->tv_nsec / 1000;
+    iomanager->addTimerUS(time_us, [iomanager, fiber]() mutable {
         iomanager->Submit(fiber);
     });
     RPC::Fiber::YieldToHold();
     return 0;
 }
 
+/**
+ * @brief 为内核新分配的句柄创建fd上下文
+ *  旧句柄没有经过hook关闭(如在非工作线程关闭)时, 留下的fd上下文和事件注册都已经失效, 先清除
+ */
+static RPC::FdContext::ptr new_fd_context(int fd) {
+    if (RPC::FdMgr::GetInstance()->getFdContext(fd)) {
+        RPC::FdMgr::GetInstance()->delFdContext(fd);
+    }
+    RPC::IOManager *iom = RPC::IOManager::GetThis();
+    if (iom) {
+        iom->cancelAllEvent(fd);
+    }
+    return RPC::FdMgr::GetInstance()->getFdContext(fd, true);
+}
+
 int socket(int domain, int type, int protocol) {
     if (!RPC::is_enable_hook()) {
         return socket_f(domain, type, protocol);
@@ -204,7 +443,11 @@ int socket(int domain, int type, int protocol) {
     if (fd == -1) {
         return fd;
     }
-    RPC::FdMgr::GetInstance()->getFdContext(fd, true);
+    RPC::FdContext::ptr fdctx = new_fd_context(fd);
+    if (fdctx && (type & SOCK_NONBLOCK)) {
+        // 创建时指定的非阻塞属于用户级非阻塞, 调用者自己处理EAGAIN
+        fdctx->setUserNonblock(true);
+    }
     return fd;
 }
 int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addrlen, uint64_t timeout) {
@@ -224,39 +467,67 @@ int connect_with_timeout(int sockfd, const struct sockaddr *addr, socklen_t addr
         return connect_f(sockfd, addr, addrlen);
     }
 
-    int n = connect_f(sockfd, addr, addrlen);
-    if (n != -1 || errno != EINPROGRESS) {
-        return n;
-    } else if (n == 0) {
-        return n;
-    }
-    std::shared_ptr<int> timecondition(new int{0});
     RPC::IOManager* iomanager = RPC::IOManager::GetThis();
     RPC_ASSERT(iomanager);
-    std::weak_ptr<int> weak_cond(timecondition);
-    RPC::Timer::ptr timer;  
-    if (timeout != (uint64_t)-1) {
-        timer = iomanager->addConditionTimer(timeout, [iomanager, weak_cond, sockfd]() {
-            auto t = weak_cond.lock();
-            if (!t || *t) {
-                return ;
-            }
-            *t = ETIMEDOUT;
-            iomanager->cancelEvent(sockfd, RPC::IOManager::WRITE);
-        }, weak_cond);
+    int res = 0;
+    // 连接超时以毫秒为单位, 定时器和io_uring使用微秒
+    uint64_t timeout_us = timeout == (uint64_t)-1 ? timeout : timeout * 1000;
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_CONNECT, sockfd, addr, 0, addrlen);
+    if (iomanager->submitIo(req, timeout_us, res)) {
+        if (res == 0) {
+            return 0;
+        }
+        if (res == -ECANCELED) {
+            res = -ETIMEDOUT;
+        }
+        if (res != -EINPROGRESS && res != -EAGAIN && res != -EALREADY) {
+            errno = -res;
+            return -1;
+        }
+        // 连接仍在进行中, 退回epoll等待可写
+    } else {
+        int n = connect_f(sockfd, addr, addrlen);
+        if (n != -1 || errno != EINPROGRESS) {
+            return n;
+        } else if (n == 0) {
+            return n;
+        }
     }
-    bool rt = iomanager->addEvent(sockfd, RPC::IOManager::Event::WRITE);
-    if (!rt) {
+    std::shared_ptr<int> timecondition(new int{0});
+    RPC::IOManager::AddEventResult rt = iomanager->tryAddEvent(sockfd, RPC::IOManager::Event::WRITE);
+    if (rt == RPC::IOManager::ADD_ERROR) {
             /* 添加事件失败*/
             RPC_LOG_ERROR(logger) << "connect_with timeout add event error";
-            if (timer) {
-                timer->cancel();
-            }
             return -1;
     }
-    RPC::Fiber::YieldToHold();
-    if (timer) {
-        timer->cancel();
+    if (rt == RPC::IOManager::ADD_BUSY) {
+        // 其他协程在等待该socket可写, 交给poll定时检查
+        pollfd pfd;
+        pfd.fd = sockfd;
+        pfd.events = POLLOUT;
+        pfd.revents = 0;
+        if (do_poll(&pfd, 1, timeout_us) == 0) {
+            *timecondition = ETIMEDOUT;
+        }
+    } else if (rt == RPC::IOManager::ADD_OK) {
+        // ADD_READY时已经可写, 直接检查连接结果
+        // 事件注册之后再添加定时器, 协程切出之前定时器触发也能取消事件
+        std::weak_ptr<int> weak_cond(timecondition);
+        RPC::Timer::ptr timer;
+        if (timeout_us != (uint64_t)-1) {
+            timer = iomanager->addConditionTimerUS(timeout_us, [iomanager, weak_cond, sockfd]() {
+                auto t = weak_cond.lock();
+                if (!t || *t) {
+                    return ;
+                }
+                *t = ETIMEDOUT;
+                iomanager->cancelEvent(sockfd, RPC::IOManager::WRITE);
+            }, weak_cond);
+        }
+        RPC::Fiber::YieldToHold();
+        if (timer) {
+            timer->cancel();
+        }
     }
     if (*timecondition) {
         errno = *timecondition;
@@ -280,72 +551,204 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 
 
 int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
-    int fd = do_io(sockfd, RPC::IOManager::READ, "accept", accept_f, addr, addrlen);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_ACCEPT, sockfd, addr, 0, (uint64_t)addrlen);
+    int fd = do_io(sockfd, RPC::IOManager::READ, "accept", &req, accept_f, addr, addrlen);
     // RPC_LOG_DEBUG(logger) << "accept finish, fd = " << fd;
     if (fd >= 0 && RPC::is_enable_hook()) {
-        RPC::FdMgr::GetInstance()->getFdContext(fd, true);
+        new_fd_context(fd);
+    }
+    return fd;
+}
+
+int accept4(int sockfd, struct sockaddr *addr, socklen_t *addrlen, int flags) {
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_ACCEPT, sockfd, addr, 0, (uint64_t)addrlen, flags);
+    int fd = do_io(sockfd, RPC::IOManager::READ, "accept4", &req, accept4_f, addr, addrlen, flags);
+    if (fd >= 0 && RPC::is_enable_hook()) {
+        RPC::FdContext::ptr fdctx = new_fd_context(fd);
+        if (fdctx && (flags & SOCK_NONBLOCK)) {
+            fdctx->setUserNonblock(true);
+        }
     }
     return fd;
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
-    return do_io(fd, RPC::IOManager::READ, "read", read_f, buf, count);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_RECV, fd, buf, count);
+    return do_io(fd, RPC::IOManager::READ, "read", &req, read_f, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, RPC::IOManager::Event::READ, "readv", readv_f, iov, iovcnt);
+    // 和read/recv一样按socket提交, READV在非阻塞socket上直接返回-EAGAIN, RECVMSG会等到数据到达
+    struct msghdr msg = make_iov_msghdr(iov, iovcnt);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_RECVMSG, fd, &msg, 1);
+    return do_io(fd, RPC::IOManager::Event::READ, "readv", &req, readv_f, iov, iovcnt);
 }
 
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-    return do_io(sockfd, RPC::IOManager::READ, "recv", recv_f, buf, len, flags);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_RECV, sockfd, buf, len, 0, flags);
+    return do_io(sockfd, RPC::IOManager::READ, "recv", &req, recv_f, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags,
                         struct sockaddr *src_addr, socklen_t *addrlen) {
-                            return do_io(sockfd, RPC::IOManager::Event::READ, "recvfrom", recvfrom_f, buf, len, flags, src_addr, addrlen);
+                            return do_io(sockfd, RPC::IOManager::Event::READ, "recvfrom", nullptr, recvfrom_f, buf, len, flags, src_addr, addrlen);
 
                         }
 
 
 ssize_t write(int fd, const void *buf, size_t count) {
-    return do_io(fd, RPC::IOManager::Event::WRITE, "write", write_f, buf, count);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_SEND, fd, buf, count);
+    return do_io(fd, RPC::IOManager::Event::WRITE, "write", &req, write_f, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, RPC::IOManager::Event::WRITE, "writev", writev_f, iov, iovcnt);
+    struct msghdr msg = make_iov_msghdr(iov, iovcnt);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_SENDMSG, fd, &msg, 1);
+    return do_io(fd, RPC::IOManager::Event::WRITE, "writev", &req, writev_f, iov, iovcnt);
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
-    return do_io(sockfd, RPC::IOManager::Event::WRITE, "send", send_f, buf, len, flags);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_SEND, sockfd, buf, len, 0, flags);
+    return do_io(sockfd, RPC::IOManager::Event::WRITE, "send", &req, send_f, buf, len, flags);
 }
 
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
                       const struct sockaddr *dest_addr, socklen_t addrlen) {
-                        return do_io(sockfd, RPC::IOManager::Event::WRITE, "sendto", sendto_f, buf, len, flags, dest_addr, addrlen);
+                        return do_io(sockfd, RPC::IOManager::Event::WRITE, "sendto", nullptr, sendto_f, buf, len, flags, dest_addr, addrlen);
 }
 
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
-    return do_io(sockfd, RPC::IOManager::Event::WRITE, "sendmsg", sendmsg_f, msg, flags);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_SENDMSG, sockfd, msg, 1, 0, flags);
+    return do_io(sockfd, RPC::IOManager::Event::WRITE, "sendmsg", &req, sendmsg_f, msg, flags);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+    return do_file_io(preadv2, pread_f, fd, buf, count, offset);
+}
+
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    return do_file_io(pwritev2, pwrite_f, fd, buf, count, offset);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return do_io(out_fd, RPC::IOManager::Event::WRITE, "sendfile", nullptr, sendfile_f, in_fd, offset, count);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    return do_poll(fds, nfds, timeout < 0 ? (uint64_t)-1 : timeout * 1000ull);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
+    uint64_t timeout_us = timeout ? timeout->tv_sec * 1000000ull + timeout->tv_usec : (uint64_t)-1;
+    if (!RPC::is_enable_hook() || timeout_us == 0) {
+        return select_f(nfds, readfds, writefds, exceptfds, timeout);
+    }
+    std::vector<struct pollfd> fds;
+    for (int fd = 0; fd < nfds; ++fd) {
+        short events = 0;
+        if (readfds && FD_ISSET(fd, readfds)) {
+            events |= POLLIN;
+        }
+        if (writefds && FD_ISSET(fd, writefds)) {
+            events |= POLLOUT;
+        }
+        if (exceptfds && FD_ISSET(fd, exceptfds)) {
+            events |= POLLPRI;
+        }
+        if (events) {
+            struct pollfd pfd;
+            pfd.fd = fd;
+            pfd.events = events;
+            pfd.revents = 0;
+            fds.push_back(pfd);
+        }
+    }
+    int n = do_poll(fds.data(), fds.size(), timeout_us);
+    if (n < 0) {
+        return n;
+    }
+    int count = 0;
+    for (auto &pfd : fds) {
+        if (pfd.revents & POLLNVAL) {
+            errno = EBADF;
+            return -1;
+        }
+    }
+    for (auto &pfd : fds) {
+        // 与内核的select一致, 出错和挂断的句柄既可读也可写
+        if (readfds && FD_ISSET(pfd.fd, readfds)) {
+            if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+                ++count;
+            } else {
+                FD_CLR(pfd.fd, readfds);
+            }
+        }
+        if (writefds && FD_ISSET(pfd.fd, writefds)) {
+            if (pfd.revents & (POLLOUT | POLLERR)) {
+                ++count;
+            } else {
+                FD_CLR(pfd.fd, writefds);
+            }
+        }
+        if (exceptfds && FD_ISSET(pfd.fd, exceptfds)) {
+            if (pfd.revents & POLLPRI) {
+                ++count;
+            } else {
+                FD_CLR(pfd.fd, exceptfds);
+            }
+        }
+    }
+    return count;
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+    if (!RPC::is_enable_hook() || timeout == 0) {
+        return epoll_wait_f(epfd, events, maxevents, timeout);
+    }
+    // epoll句柄上有就绪事件时可读, 等它可读后再以0超时取出事件
+    uint64_t deadline = timeout < 0 ? (uint64_t)-1 : RPC::GetMonotonicUS() + timeout * 1000ull;
+    while (true) {
+        struct pollfd pfd;
+        pfd.fd = epfd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        uint64_t timeout_us = (uint64_t)-1;
+        if (deadline != (uint64_t)-1) {
+            uint64_t now = RPC::GetMonotonicUS();
+            timeout_us = deadline > now ? deadline - now : 0;
+        }
+        int n = do_poll(&pfd, 1, timeout_us);
+        if (n <= 0) {
+            return n;
+        }
+        n = epoll_wait_f(epfd, events, maxevents, 0);
+        if (n != 0 || timeout_us == 0) {
+            return n;
+        }
+        // 事件已经被其他线程取走, 继续等待
+    }
 }
 
 int close(int fd) {
     if (!RPC::is_enable_hook()) {
         return close_f(fd);
     }
+    auto iom = RPC::IOManager::GetThis();
+    if (iom) {
+        // 管道、eventfd等没有fd上下文的句柄也可能被poll注册过, 都要清除注册, 否则复用句柄号的socket不会重新注册
+        iom->cancelAllEvent(fd);
+    }
     RPC::FdContext::ptr fdctx = RPC::FdMgr::GetInstance()->getFdContext(fd);
     if (fdctx) {
-        auto iom = RPC::IOManager::GetThis();
-        if (iom) {
-            iom->cancelAllEvent(fd);
-        }
         RPC::FdMgr::GetInstance()->delFdContext(fd);
     }
 
     return close_f(fd);
 }
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
-    return do_io(sockfd, RPC::IOManager::Event::READ, "recvmsg", recvmsg_f, msg, flags);
+    RPC::IOManager::IoRequest req = make_io_request(IORING_OP_RECVMSG, sockfd, msg, 1, 0, flags);
+    return do_io(sockfd, RPC::IOManager::Event::READ, "recvmsg", &req, recvmsg_f, msg, flags);
 }
 int fcntl(int fd, int cmd, ...) {
     va_list va;
@@ -476,7 +879,7 @@ int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t
             auto fdctx = RPC::FdMgr::GetInstance()->getFdContext(sockfd);
             if (fdctx) {
                 const timeval *tm = (const timeval *)optval;
-                fdctx->setTimeout(optname, tm->tv_sec * 1000 + tm->tv_usec / 1000);
+                fdctx->setTimeout(optname, tm->tv_sec * 1000000ull + tm->tv_usec);
             }
         }
     }
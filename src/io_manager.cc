@@ -1,28 +1,70 @@
 #include "io_manager.h"
+#include "fd_manager.h"
+#include "epoch.h"
+#include "hook.h"
 #include "log.h"
 #include "macro.h"
+#include "uring.h"
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <string.h>
-#include <fcntl.h>
 
 namespace RPC {
 static Logger::ptr logger = RPC_LOG_ROOT();
-IOManager::IOManager(size_t threads, const std::string &name):Scheduler(threads, name) {
-    int rt = pipe(pipefd_);
-    RPC_ASSERT(rt == 0);
-    epollfd_ = epoll_create(5);
-    RPC_ASSERT(epollfd_ > 0);
-
-    epoll_event event;
-    memset(&event, 0, sizeof(event));
-    event.data.fd = pipefd_[0];
-    event.events = EPOLLIN | EPOLLET;
-    rt = fcntl(pipefd_[0], F_SETFL, O_NONBLOCK);
-    RPC_ASSERT(rt == 0);
-    rt = epoll_ctl(epollfd_, EPOLL_CTL_ADD, pipefd_[0], &event);
-    RPC_ASSERT(rt == 0);
-    contextResize(64);
+/* 每个工作线程io_uring提交队列的大小 */
+static const unsigned s_uring_entries = 256;
+/* epoll_data最高位标记内部句柄, 低位为reactor中的序号: 0是唤醒用的eventfd, i+1是第i个io_uring */
+static const uint64_t s_internal_event = 1ull << 63;
+/* 线程一直有任务时, 每执行这么多个协程检查一次到期的定时器 */
+static const uint32_t s_timer_check_interval = 16;
+static thread_local uint32_t t_yield_count = 0;
+
+/**
+ * @brief 超时时间精确到微秒的epoll_wait
+ *  使用epoll_pwait2(Linux 5.11), 内核不支持时退回epoll_wait, 超时向上取整到毫秒, 不会早于定时器返回
+ */
+static int EpollWaitUS(int epfd, epoll_event *events, int maxevents, uint64_t timeout_us) {
+#ifdef SYS_epoll_pwait2
+    static std::atomic<bool> s_has_pwait2{true};
+    if (s_has_pwait2.load(std::memory_order_relaxed)) {
+        struct timespec ts;
+        ts.tv_sec = timeout_us / 1000000;
+        ts.tv_nsec = timeout_us % 1000000 * 1000;
+        int rt = syscall(SYS_epoll_pwait2, epfd, events, maxevents, &ts, nullptr, 0);
+        if (rt >= 0 || errno != ENOSYS) {
+            return rt;
+        }
+        s_has_pwait2 = false;
+    }
+#endif
+    return epoll_wait_f(epfd, events, maxevents, (int)((timeout_us + 999) / 1000));
+}
+IOManager::IOManager(size_t threads, const std::string &name, bool reactor_per_thread,
+                     bool persistent_event)
+    :Scheduler(threads, name), TimerManager(threads), persistentEvent_(persistent_event) {
+    size_t count = reactor_per_thread && threads > 1 ? threads : 1;
+    for (size_t i = 0; i < count; ++i) {
+        Reactor *reactor = new Reactor;
+        reactors_.emplace_back(reactor);
+        // eventfd的计数器不会写满, 一次read就能清空所有唤醒
+        reactor->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        RPC_ASSERT(reactor->eventfd >= 0);
+        reactor->epollfd = epoll_create(5);
+        RPC_ASSERT(reactor->epollfd > 0);
+
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.data.u64 = s_internal_event;
+        event.events = EPOLLIN | EPOLLET;
+        int rt = epoll_ctl(reactor->epollfd, EPOLL_CTL_ADD, reactor->eventfd, &event);
+        RPC_ASSERT(rt == 0);
+    }
+    for (auto &chunk : contextChunks_) {
+        chunk.store(nullptr, std::memory_order_relaxed);
+    }
+    initIoUring();
     Start();
 
 }
@@ -34,101 +76,167 @@ IOManager::~IOManager() {
         sleep(3);
     }
     Stop();
-    close(epollfd_);
-    close(pipefd_[0]);
-    close(pipefd_[1]);
-    for (size_t i = 0; i < fdContext_.size(); ++i) {
-        if (fdContext_[i])
-            delete fdContext_[i];
+    for (auto &reactor : reactors_) {
+        close(reactor->epollfd);
+        close(reactor->eventfd);
+    }
+    for (auto &chunk : contextChunks_) {
+        delete[] chunk.load(std::memory_order_relaxed);
     }
 }
 
-void IOManager::contextResize(size_t size) {
-    size_t old_size = fdContext_.size();
-    fdContext_.resize(size);
-    for (size_t i = old_size; i < size; ++i) {
-        fdContext_[i] = new FdContext;
-        fdContext_[i]->fd = i;
-    }
+uint64_t IOManager::EventData(const FdContext *context) {
+    return (uint64_t)(context->generation & 0x7fffffff) << 32 | (uint32_t)context->fd;
 }
 
 bool IOManager::addEvent(int fd, Event event, std::function<void()> callback) {
-    FdContext * context = nullptr;
-    RWMutexType::ReadLock lock(mutex_);
-    if ((int)fdContext_.size() > fd) {
-        // 能匹配到socket上下文
-        context = fdContext_[fd];
-        lock.unlock();
-    } else {
-        // 不能匹配到socket上下文
-        lock.unlock();
-        RWMutexType::WriteLock wlock(mutex_); 
-        contextResize(fd * 1.5);
-        context = fdContext_[fd];
+    return doAddEvent(fd, event, callback, nullptr, false) != ADD_ERROR;
+}
+
+IOManager::AddEventResult IOManager::tryAddEvent(int fd, Event event, std::function<void()> callback,
+                                                 const void *owner) {
+    return doAddEvent(fd, event, callback, owner, true);
+}
+
+/**
+ * @brief 句柄是否由hook创建并跟踪(有fd上下文), 这样的句柄由hook的close取消注册
+ */
+static bool IsTrackedFd(int fd) {
+    Epoch::Guard guard;
+    return FdMgr::GetInstance()->lookup(fd) != nullptr;
+}
+
+IOManager::AddEventResult IOManager::doAddEvent(int fd, Event event, std::function<void()> &callback,
+                                                const void *owner, bool try_add) {
+    FdContext *context = getContext(fd);
+    if (!context) {
+        RPC_LOG_ERROR(logger) << "IOManager::addEvent error fd out of range fd=" << fd;
+        return ADD_ERROR;
     }
     FdContext::MutexType::Lock lock1(context->mutex);
     if (context->events & event) {
+        if (try_add) {
+            // 同一个句柄的同一方向已经有其他协程在等待(如poll和read同一个socket)
+            return ADD_BUSY;
+        }
         // 事件已经注册
         RPC_LOG_ERROR(logger) << "fd=" << fd << " addEvent fail, event already register. "
                 << "event=" << event << " FdContext->event=" << context->events;
         RPC_ASSERT(!(context->events & event));
     }
-    int op = context->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
-    epoll_event ep_event;
-    memset(&ep_event, 0, sizeof(epoll_event));
-    ep_event.data.fd = fd;
-    ep_event.data.ptr = context;
-    Event new_event =   (Event) (event | context->events);
-    context->events = new_event;
-    ep_event.events = new_event | EPOLLET;
-    int rt = epoll_ctl(epollfd_, op, fd, &ep_event);
-    if (rt != 0) {
-        RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd_ << ", " << op << ", " << fd << ", "
-                << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;
+    bool ready = false;
+    if (persistentEvent_ && !context->registered && !context->events && IsTrackedFd(fd)) {
+        // 只常驻注册hook跟踪的socket; 管道等句柄可能不经过hook关闭, 仍然一次性注册, 不会留下失效的注册
+        context->reactor = pickReactor();
+        int epollfd = reactors_[context->reactor]->epollfd;
+        epoll_event ep_event;
+        memset(&ep_event, 0, sizeof(epoll_event));
+        ep_event.data.u64 = EventData(context);
+        ep_event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        int rt = epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &ep_event);
+        if (rt != 0) {
+            RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd << ", " << EPOLL_CTL_ADD << ", " << fd << ", "
+                    << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return ADD_ERROR;
+        }
+        context->registered = true;
+    }
+    if (context->registered) {
+        if (context->ready & event) {
+            // 上次等待之后已经触发过边沿, 不会再次通知, 直接唤醒; 数据已被读走时调用者重试后再次等待
+            context->ready = (Event)(context->ready & ~event);
+            if (try_add) {
+                // 调用者自己重试, 不需要切出协程再被唤醒
+                return ADD_READY;
+            }
+            ready = true;
+        }
+        context->events = (Event)(event | context->events);
+    } else {
+        int op = context->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (!context->events) {
+            // 句柄不在任何epoll中, 重新选择绑定的实例
+            context->reactor = pickReactor();
+        }
+        int epollfd = reactors_[context->reactor]->epollfd;
+        epoll_event ep_event;
+        memset(&ep_event, 0, sizeof(epoll_event));
+        ep_event.data.u64 = EventData(context);
+        Event new_event =   (Event) (event | context->events);
+        ep_event.events = new_event | EPOLLET;
+        int rt = epoll_ctl(epollfd, op, fd, &ep_event);
+        if (rt != 0) {
+            // 失败时不记录事件, 否则之后的addEvent会认为事件已经注册
+            RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd << ", " << op << ", " << fd << ", "
+                    << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return ADD_ERROR;
+        }
+        context->events = new_event;
     }
     pendingEventCount_++;
     // 设置事件的回调执行相关信息（调度器，回调函数，协程）
     FdContext::EventContext &eventContext = context->getEventContext(event);
     RPC_ASSERT(eventContext.empty())
     eventContext.scheduler = Scheduler::GetThis();
+    eventContext.owner = owner;
     if (callback) {
         eventContext.callback.swap(callback);
     } else {
         eventContext.fiber = Fiber::GetThis();
         RPC_ASSERT(eventContext.fiber->GetState() == Fiber::EXEC);
     }
-
-    return true;
+    if (ready) {
+        context->triggerEvent(event);
+        --pendingEventCount_;
+    }
+    return ADD_OK;
 }
 
 bool IOManager::delEvent(int fd, Event event) {
-    FdContext *context = nullptr;
-    RWMutexType::ReadLock lock(mutex_);
-    if ((int)fdContext_.size() <= fd) {
+    FdContext *context = findContext(fd);
+    if (!context) {
         RPC_LOG_ERROR(logger) << "IOManager::delEvent error fd not exist fd=" << fd << " context event=" << event;
         return false;
     }
-    context = fdContext_[fd];
-    lock.unlock();
     FdContext::MutexType::Lock lock1(context->mutex);
     if (!(context->events & event)) {
         RPC_LOG_ERROR(logger) << "IOManager::delEvent error event not exist fd=" << fd 
         << " context event=" << event;
         return false;
     }
+    return unregisterEvent(context, event);
+}
+
+bool IOManager::removeEvent(int fd, Event event, const void *owner) {
+    FdContext *context = findContext(fd);
+    if (!context) {
+        return false;
+    }
+    FdContext::MutexType::Lock lock1(context->mutex);
+    if (!(context->events & event) || context->getEventContext(event).owner != owner) {
+        // 已经触发, 或者触发后又被其他等待者注册
+        return false;
+    }
+    return unregisterEvent(context, event);
+}
+
+bool IOManager::unregisterEvent(FdContext *context, Event event) {
+    int fd = context->fd;
     Event new_event = (Event)(context->events & ~event);
-    int op = context->events? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-    epoll_event ep_event;
-    memset(&ep_event, 0, sizeof(epoll_event));
-    ep_event.data.fd = fd;
-    ep_event.data.ptr = context;
-    ep_event.events = new_event | EPOLLET;
-    int rt = epoll_ctl(epollfd_, op, fd, &ep_event);
-    if (rt != 0) {
-        RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd_ << ", " << op << ", " << fd << ", "
-                << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false; 
+    if (!context->registered) {
+        // 剩余的事件为空时从epoll中移除, 之后addEvent才能重新ADD
+        int op = new_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+        int epollfd = reactors_[context->reactor]->epollfd;
+        epoll_event ep_event;
+        memset(&ep_event, 0, sizeof(epoll_event));
+        ep_event.data.u64 = EventData(context);
+        ep_event.events = new_event | EPOLLET;
+        int rt = epoll_ctl(epollfd, op, fd, &ep_event);
+        if (rt != 0) {
+            RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd << ", " << op << ", " << fd << ", "
+                    << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false; 
+        }
     }
 
     --pendingEventCount_;
@@ -139,32 +247,31 @@ bool IOManager::delEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelEvent(int fd, Event event) {
-    FdContext *context = nullptr;
-    RWMutexType::ReadLock lock(mutex_);
-    if ((int)fdContext_.size() <= fd) {
+    FdContext *context = findContext(fd);
+    if (!context) {
         RPC_LOG_ERROR(logger) << "IOManager::cancelEvent error fd not exist fd=" << fd << " context event=" << event;
         return false;
     }
-    context = fdContext_[fd];
-    lock.unlock();
     FdContext::MutexType::Lock lock1(context->mutex);
     if (!(context->events & event)) {
         RPC_LOG_ERROR(logger) << "IOManager::cancelEvent error event not exist fd=" << fd 
             << " context event=" << event;
         return false;    
     }
-    Event new_event = (Event)(context->events & ~event);
-    int op = context->events ? EPOLL_CTL_MOD: EPOLL_CTL_DEL;
-    epoll_event ep_event;
-    memset(&ep_event, 0, sizeof(epoll_event));
-    ep_event.data.ptr = context;
-    ep_event.data.fd = fd;
-    ep_event.events = EPOLLET | new_event;
-    int rt = epoll_ctl(epollfd_, op, fd, &ep_event);
-    if (rt != 0) {
-        RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd_ << ", " << op << ", " << fd << ", "
-                << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false; 
+    if (!context->registered) {
+        Event new_event = (Event)(context->events & ~event);
+        int op = new_event ? EPOLL_CTL_MOD: EPOLL_CTL_DEL;
+        int epollfd = reactors_[context->reactor]->epollfd;
+        epoll_event ep_event;
+        memset(&ep_event, 0, sizeof(epoll_event));
+        ep_event.data.u64 = EventData(context);
+        ep_event.events = EPOLLET | new_event;
+        int rt = epoll_ctl(epollfd, op, fd, &ep_event);
+        if (rt != 0) {
+            RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd << ", " << op << ", " << fd << ", "
+                    << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false; 
+        }
     }
     context->triggerEvent(event);
     --pendingEventCount_;
@@ -172,27 +279,41 @@ bool IOManager::cancelEvent(int fd, Event event) {
 }
 
 bool IOManager::cancelAllEvent(int fd) {
-    RWMutexType::ReadLock lock(mutex_);
-    if ((int)fdContext_.size() <= fd) {
+    FdContext *fdctx = findContext(fd);
+    if (!fdctx) {
         return false;
     }
-    auto fdctx = fdContext_[fd];
-    lock.unlock();
+    if (fdctx->uringOps > 0) {
+        cancelIo(fd);
+    }
     FdContext::MutexType::Lock lock1(fdctx->mutex);
+    // 句柄即将关闭, 已经从epoll_wait取出但还没有处理的事件属于旧句柄
+    ++fdctx->generation;
+    bool persistent = fdctx->registered;
+    if (persistent) {
+        // 句柄即将关闭, 复用同一句柄号的新socket需要重新注册
+        // 句柄号被重新分配时旧句柄已经没有经过hook关闭, 内核已经从epoll中移除(ENOENT)
+        int epollfd = reactors_[fdctx->reactor]->epollfd;
+        int rt = epoll_ctl(epollfd, EPOLL_CTL_DEL, fdctx->fd, nullptr);
+        if (rt != 0 && errno != ENOENT) {
+            RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd << ", " << EPOLL_CTL_DEL << ", " << fd
+                    << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+        }
+        fdctx->registered = false;
+        fdctx->ready = NONE;
+    }
     if (!fdctx->events) {
         return false;
     }
-    int op = EPOLL_CTL_MOD;
-    epoll_event ep_event;
-    memset(&ep_event, 0, sizeof(epoll_event));
-    ep_event.data.fd = fdctx->fd;
-    ep_event.data.ptr = fdctx;
-    ep_event.events = 0;
-    int rt = epoll_ctl(epollfd_, op, fdctx->fd, &ep_event);
-    if (rt != 0) {
-        RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd_ << ", " << op << ", " << fd << ", "
-                << ep_event.events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
-        return false;         
+    if (!persistent) {
+        int op = EPOLL_CTL_DEL;
+        int epollfd = reactors_[fdctx->reactor]->epollfd;
+        int rt = epoll_ctl(epollfd, op, fdctx->fd, nullptr);
+        if (rt != 0 && errno != ENOENT) {
+            RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd << ", " << op << ", " << fd
+                    << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+            return false;         
+        }
     }
     if (fdctx->events & READ) {
         fdctx->triggerEvent(READ);
@@ -220,9 +341,10 @@ void IOManager::FdContext::resetContext(EventContext &event) {
     event.scheduler = nullptr;
     event.fiber.reset();
     event.callback = nullptr;
+    event.owner = nullptr;
 }
 
-void IOManager::FdContext::triggerEvent(Event event) {
+void IOManager::FdContext::triggerEvent(Event event, TriggerBatch *batch) {
     if (!(events & event)) {
         // Fd上下文没有注册该事件
         RPC_LOG_ERROR(logger) << "ASSERTION: " << (events & event)
@@ -232,7 +354,13 @@ void IOManager::FdContext::triggerEvent(Event event) {
     events = (Event)(events & ~event);
     FdContext::EventContext &event_context = getEventContext(event);
     // 把回调函数触发一下
-    if (event_context.callback != nullptr) {
+    if (batch && event_context.scheduler == batch->scheduler) {
+        if (event_context.callback != nullptr) {
+            batch->callbacks.push_back(std::move(event_context.callback));
+        } else {
+            batch->fibers.push_back(std::move(event_context.fiber));
+        }
+    } else if (event_context.callback != nullptr) {
         event_context.scheduler->Submit(std::move(event_context.callback));
     } else {
         event_context.scheduler->Submit(std::move(event_context.fiber));
@@ -244,22 +372,33 @@ void IOManager::Wait() {
     const uint64_t MAX_EVENTS = 256;
     epoll_event *events = new epoll_event[MAX_EVENTS];
     std::unique_ptr<epoll_event[]> uniqueptr(events);
+    TriggerBatch batch;
+    batch.scheduler = this;
+    // 独立epoll模式下每个工作线程等待自己的实例, 触发的协程回到本线程执行
+    int index = isReactorPerThread() ? getWorkerIndex() : -1;
+    Reactor *reactor = reactors_[index >= 0 ? index : 0].get();
+    int thread = index >= 0 ? GetThreadId() : -1;
     while (true) {
-        // 获取epoll_wait 的时间
-        uint64_t next_time = getNextTimerTime();
+        // 获取epoll_wait 的时间(微秒)
+        uint64_t next_time = getNextTimerTimeUS();
         if (Stopping()) {
             RPC_LOG_ERROR(logger) << "already stop";
             return;
         }
         int rt = 0;
         do {
-            static const int MAX_TIMEROUT = 3000;
-            if (next_time != ~0ull) {
-                next_time = std::min((int)next_time, MAX_TIMEROUT);
-            } else {
-                next_time = MAX_TIMEROUT;
+            static const uint64_t MAX_TIMEROUT = 3000 * 1000;
+            next_time = std::min(next_time, MAX_TIMEROUT);
+            reactor->idle = true;
+            // 与Notify中的fence配对, 先公开idle再检查任务: 两边至少有一方能看到另一方的修改
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (hasRunnableTask()) {
+                // 还有能执行的任务(如协程未切出时放回inbox的任务), 自己放回的任务不会唤醒本线程, 只收割事件不阻塞
+                next_time = 0;
             }
-            rt = epoll_wait(epollfd_, events, MAX_EVENTS, (int)next_time);
+            rt = EpollWaitUS(reactor->epollfd, events, MAX_EVENTS, next_time);
+            reactor->idle = false;
+            UpdateCachedClock();
             if (rt < 0 && errno == EINTR) {
                 continue;
             } else {
@@ -267,23 +406,38 @@ void IOManager::Wait() {
             }
         } while(true);
         // 处理要触发的定时器任务
+        // 和IO事件一样, 独立epoll模式下本线程的定时器在本线程执行
         std::vector<std::function<void()>> cb;
         listOverTimeCallback(cb);
-        for (auto &it : cb) {
-            Submit(it);
-        }
+        SubmitBatch(cb.begin(), cb.end(), thread);
         for (int i = 0; i < rt; ++i) {
-            int fd = events[i].data.fd;
-            if (fd == pipefd_[0]) {
-                uint8_t dummy[256];
-                while(read(pipefd_[0], dummy, sizeof(dummy)) > 0);
+            uint64_t data = events[i].data.u64;
+            if (data & s_internal_event) {
+                size_t index = data & ~s_internal_event;
+                if (index == 0) {
+                    // 先清除标记再读, 读之后的唤醒会重新写入eventfd, 不会丢失
+                    reactor->wakeupPending = false;
+                    uint64_t dummy;
+                    while (read(reactor->eventfd, &dummy, sizeof(dummy)) > 0);
+                } else {
+                    reapIo(reactor->rings[index - 1], batch);
+                }
+                continue;
+            }
+            int fd = (int)(uint32_t)data;
+            FdContext *fdcontext = findContext(fd);
+            if (!fdcontext) {
                 continue;
             }
-            FdContext *fdcontext = static_cast<FdContext *>(events->data.ptr);
             FdContext::MutexType::Lock lock(fdcontext->mutex); 
+            if (EventData(fdcontext) != data) {
+                // 句柄已经关闭, 句柄号可能已经被新的socket复用, 丢弃旧的事件
+                continue;
+            }
             if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-                //关闭的连接
-                events[i].events |= ((EPOLLIN | EPOLLOUT) & fdcontext->events);
+                //关闭的连接, 常驻注册模式下两个方向都要记录
+                events[i].events |= fdcontext->registered ? (EPOLLIN | EPOLLOUT)
+                                                     : ((EPOLLIN | EPOLLOUT) & fdcontext->events);
             }
             int real_event = NONE;
             if (events[i].events & EPOLLIN) {
@@ -294,46 +448,267 @@ void IOManager::Wait() {
                 // 可写事件
                 real_event |= WRITE;
             }
-            if ((real_event & fdcontext->events) == NONE) {
-                continue;
-            } 
-            // 每次触发的事件 都要删除（即事件触发一次）
-            int left_event = fdcontext->events & ~real_event;
-            int op = left_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
-            events[i].events = left_event | EPOLLET;
-            int rt = epoll_ctl(epollfd_, op, fdcontext->fd, &events[i]);
-            if (rt != 0) {
-                RPC_LOG_ERROR(logger) << "epoll_ctl(" << epollfd_ << ", " << op << ", " << fd << ", "
-                    << events[i].events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
-                continue;
+            if (fdcontext->registered) {
+                // 注册保持不变, 没有等待者的事件记录下来, 下一次addEvent时直接唤醒
+                fdcontext->ready = (Event)(fdcontext->ready | (real_event & ~fdcontext->events));
+                real_event &= fdcontext->events;
+                if (real_event == NONE) {
+                    continue;
+                }
+            } else {
+                if ((real_event & fdcontext->events) == NONE) {
+                    continue;
+                } 
+                // 每次触发的事件 都要删除（即事件触发一次）
+                int left_event = fdcontext->events & ~real_event;
+                int op = left_event ? EPOLL_CTL_MOD : EPOLL_CTL_DEL;
+                events[i].events = left_event | EPOLLET;
+                int rt = epoll_ctl(reactor->epollfd, op, fdcontext->fd, &events[i]);
+                if (rt != 0) {
+                    RPC_LOG_ERROR(logger) << "epoll_ctl(" << reactor->epollfd << ", " << op << ", " << fd << ", "
+                        << events[i].events << "):" << rt << " (" << errno << ") (" << strerror(errno) << ")";
+                    continue;
+                }
             }
             // 调用事件的回调函数
             if (real_event & READ) {
-                fdcontext->triggerEvent(READ);
+                fdcontext->triggerEvent(READ, &batch);
                 --pendingEventCount_;
             }
             if (real_event & WRITE) {
-                fdcontext->triggerEvent(WRITE);
+                fdcontext->triggerEvent(WRITE, &batch);
                 --pendingEventCount_;
             }
         }
+        // 一轮触发的IO事件批量提交, 只通知一次
+        SubmitBatch(batch.callbacks.begin(), batch.callbacks.end(), thread);
+        SubmitBatch(batch.fibers.begin(), batch.fibers.end(), thread);
+        batch.callbacks.clear();
+        batch.fibers.clear();
         // 挂起协程执行调度任务
         Fiber::YieldToHold();
     }
 }
 
 void IOManager::Notify() {
+    // 与Wait中设置idle之后的fence配对, 任务入队之后才检查是否有空闲的线程,
+    // 否则检查可能被重排到入队之前, 刚进入epoll_wait的线程要等到超时才发现任务
+    std::atomic_thread_fence(std::memory_order_seq_cst);
     if (!hasIdleThreads()) {
         return;
     }
-    int rt = write(pipefd_[1], "N", 1);
-    RPC_ASSERT(rt == 1);
+    if (!isReactorPerThread()) {
+        wakeReactor(reactors_[0].get());
+        return;
+    }
+    // 唤醒一个阻塞在epoll_wait上的线程, 停止时唤醒所有线程
+    for (auto &reactor : reactors_) {
+        if (reactor->idle) {
+            wakeReactor(reactor.get());
+            if (!stop_) {
+                return;
+            }
+        }
+    }
+}
+
+bool IOManager::NotifyWorker(size_t index) {
+    if (!isReactorPerThread()) {
+        return false;
+    }
+    // 目标线程可能正要进入epoll_wait, 不检查idle直接唤醒
+    wakeReactor(reactors_[index].get());
+    return true;
+}
+
+void IOManager::wakeReactor(Reactor *reactor) {
+    if (reactor->wakeupPending.exchange(true)) {
+        ++notifySuppressed_;
+        return;
+    }
+    ++notifyIssued_;
+    uint64_t one = 1;
+    int rt = write(reactor->eventfd, &one, sizeof(one));
+    RPC_ASSERT(rt == sizeof(one));
+}
+
+IOManager::NotifyStats IOManager::getNotifyStats() const {
+    NotifyStats stats;
+    stats.issued = notifyIssued_;
+    stats.suppressed = notifySuppressed_;
+    return stats;
+}
+
+int IOManager::pickReactor() {
+    if (!isReactorPerThread()) {
+        return 0;
+    }
+    int index = getWorkerIndex();
+    if (index >= 0) {
+        return index;
+    }
+    return nextReactor_++ % reactors_.size();
+}
+
+void IOManager::initIoUring() {
+#ifdef RPC_IO_URING
+    for (size_t i = 0; i < threadCount_; ++i) {
+        IoUring::ptr ring(new IoUring);
+        if (!ring->init(s_uring_entries)) {
+            RPC_LOG_WARN(logger) << "io_uring unavailable, IOManager " << this << " fallback to epoll";
+            rings_.clear();
+            return;
+        }
+        rings_.push_back(ring);
+    }
+    for (size_t i = 0; i < rings_.size(); ++i) {
+        // 独立epoll模式下完成事件由对应的线程收割
+        Reactor *reactor = reactors_[isReactorPerThread() ? i : 0].get();
+        epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.data.u64 = s_internal_event | (reactor->rings.size() + 1);
+        event.events = EPOLLIN | EPOLLET;
+        int rt = epoll_ctl(reactor->epollfd, EPOLL_CTL_ADD, rings_[i]->getEventFd(), &event);
+        RPC_ASSERT(rt == 0);
+        reactor->rings.push_back(rings_[i].get());
+    }
+#endif
+}
+
+IOManager::FdContext* IOManager::getContext(int fd) {
+    FdContext *context = findContext(fd);
+    if (context || (unsigned)fd >= MAX_CONTEXTS) {
+        return context;
+    }
+    Mutex::Lock lock(chunkMutex_);
+    std::atomic<FdContext *> &slot = contextChunks_[fd >> CONTEXT_CHUNK_BITS];
+    FdContext *chunk = slot.load(std::memory_order_relaxed);
+    if (!chunk) {
+        chunk = new FdContext[CONTEXT_CHUNK_SIZE];
+        int base = fd & ~(int)(CONTEXT_CHUNK_SIZE - 1);
+        for (unsigned i = 0; i < CONTEXT_CHUNK_SIZE; ++i) {
+            chunk[i].fd = base + i;
+        }
+        slot.store(chunk, std::memory_order_release);
+    }
+    return &chunk[fd & (CONTEXT_CHUNK_SIZE - 1)];
+}
+
+bool IOManager::submitIo(const IoRequest &req, uint64_t timeout, int &res) {
+    int index = getWorkerIndex();
+    Fiber::ptr fiber = Fiber::GetThis();
+    // 共享栈协程切出后栈内容会被换走, 内核不能直接读写栈上的缓冲区
+    if (rings_.empty() || index < 0 || fiber->isSharedStack()) {
+        return false;
+    }
+    IoUring *ring = rings_[index].get();
+    IoCompletion done;
+    done.fiber = std::move(fiber);
+    done.context = getContext(req.fd);
+    // 链接的超时请求在提交时才读取, 提交发生在协程切出之后, 栈上的ts仍然有效
+    struct __kernel_timespec ts;
+    unsigned need = timeout != (uint64_t)-1 ? 2 : 1;
+    ++done.context->uringOps;
+    ++pendingEventCount_;
+    {
+        IoUring::MutexType::Lock lock(ring->sqMutex());
+        if (ring->sqSpace() < need) {
+            ring->submit();
+        }
+        if (ring->sqSpace() < need) {
+            lock.unlock();
+            --done.context->uringOps;
+            --pendingEventCount_;
+            return false;
+        }
+        io_uring_sqe *sqe = ring->getSqe();
+        sqe->opcode = req.opcode;
+        sqe->fd = req.fd;
+        sqe->addr = req.addr;
+        sqe->len = req.len;
+        sqe->off = req.off;
+        sqe->msg_flags = req.flags;
+        sqe->user_data = (uint64_t)&done;
+        if (need == 2) {
+            sqe->flags |= IOSQE_IO_LINK;
+            ts.tv_sec = timeout / 1000000;
+            ts.tv_nsec = timeout % 1000000 * 1000;
+            io_uring_sqe *timeout_sqe = ring->getSqe();
+            timeout_sqe->opcode = IORING_OP_LINK_TIMEOUT;
+            timeout_sqe->addr = (uint64_t)&ts;
+            timeout_sqe->len = 1;
+            timeout_sqe->user_data = 0;
+        }
+    }
+    Fiber::YieldToHold();
+    res = done.res;
+    return true;
+}
+
+void IOManager::onFiberYield() {
+    // 协程切出后缓存的时间过期, 下一个协程添加定时器或写日志时才读取时钟
+    InvalidateCachedClock();
+    // 线程一直有任务时不会进入Wait, 在这里处理本线程到期的定时器, 每隔几个协程检查一次
+    if (++t_yield_count % s_timer_check_interval == 0 && hasExpiredTimer()) {
+        std::vector<std::function<void()>> cb;
+        listOverTimeCallback(cb);
+        SubmitBatch(cb.begin(), cb.end(), isReactorPerThread() ? GetThreadId() : -1);
+    }
+    if (rings_.empty()) {
+        return;
+    }
+    int index = getWorkerIndex();
+    if (index < 0) {
+        return;
+    }
+    IoUring *ring = rings_[index].get();
+    IoUring::MutexType::Lock lock(ring->sqMutex());
+    if (ring->hasPending()) {
+        ring->submit();
+    }
+}
+
+void IOManager::reapIo(IoUring *ring, TriggerBatch &batch) {
+    // 先清空eventfd再收割, 收割期间新的完成事件会再次触发eventfd
+    uint64_t dummy;
+    while (read(ring->getEventFd(), &dummy, sizeof(dummy)) > 0);
+    ring->reap([this, &batch](uint64_t data, int res) {
+        if (!data) {
+            // 链接的超时和取消请求
+            return;
+        }
+        IoCompletion *done = (IoCompletion *)data;
+        done->res = res;
+        --done->context->uringOps;
+        --pendingEventCount_;
+        batch.fibers.push_back(std::move(done->fiber));
+    });
+}
+
+void IOManager::cancelIo(int fd) {
+    for (auto &ring : rings_) {
+        IoUring::MutexType::Lock lock(ring->sqMutex());
+        io_uring_sqe *sqe = ring->getSqe();
+        if (!sqe) {
+            ring->submit();
+            sqe = ring->getSqe();
+        }
+        if (!sqe) {
+            RPC_LOG_ERROR(logger) << "IOManager::cancelIo fd=" << fd << " submission queue full";
+            continue;
+        }
+        // 内核不支持按句柄取消时返回-EINVAL, 请求会在对端关闭或数据到达时完成
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = 0;
+        ring->submit();
+    }
 }
 
 bool IOManager::Stopping() {
     //定时器没有任务且 没有事件 且 协程调度器停止时 IOManager停止
-    uint64_t timeout = getNextTimerTime();
-    return pendingEventCount_ == 0 && Scheduler::Stopping() && timeout == ~0ull;
+    return pendingEventCount_ == 0 && Scheduler::Stopping() && !hasTimer();
 }
 
 void IOManager::onTimerInsertedAtFront() {
@@ -117,7 +117,7 @@ namespace RPC {
         if (level < level_) {
             return;
         }
-        uint64_t now = time(0);
+        uint64_t now = GetCachedTime();
         if (now > last_time_ + 3) {
             reopen();
             last_time_ = now;
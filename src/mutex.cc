@@ -103,7 +103,11 @@ void CoCondVar::wait() {
 }
 
 bool CoCondVar::waitFor(CoMutex::Lock &lock, uint64_t timeout) {
-    if (timeout == (uint64_t)-1) {
+    return waitForUS(lock, timeout == (uint64_t)-1 ? timeout : timeout * 1000);
+}
+
+bool CoCondVar::waitForUS(CoMutex::Lock &lock, uint64_t timeout_us) {
+    if (timeout_us == (uint64_t)-1) {
         wait(lock);
         return true;
     }
@@ -116,7 +120,7 @@ bool CoCondVar::waitFor(CoMutex::Lock &lock, uint64_t timeout) {
         MutexType::Lock lock1(mutex_);
         waitQueue_.insert(fiber);
         lock.unlock();
-        timer = iom->addConditionTimer(timeout, [weakptr, iom, fiber, this]() mutable{
+        timer = iom->addConditionTimerUS(timeout_us, [weakptr, iom, fiber, this]() mutable{
             MutexType::Lock lock(mutex_);
             auto it = weakptr.lock();
             if (!it) {
@@ -144,6 +148,136 @@ bool CoCondVar::waitFor(CoMutex::Lock &lock, uint64_t timeout) {
 
 }
 
+FiberWaiter::FiberWaiter()
+    :fiber_(Fiber::GetThis()), iom_(IOManager::GetThis()) {
+    iom_->beginExternalWait();
+}
+
+bool FiberWaiter::claim() {
+    bool expected = false;
+    if (!woken_.compare_exchange_strong(expected, true)) {
+        return false;
+    }
+    return true;
+}
+
+bool FiberWaiter::wake(const void *source) {
+    if (!claim()) {
+        return false;
+    }
+    source_ = source;
+    // 协程可能还没有切出, 调度器会把仍在执行的协程放回队列
+    iom_->Submit(fiber_);
+    iom_->endExternalWait();
+    return true;
+}
+
+bool FiberWaiter::park(uint64_t timeout_us) {
+    Timer::ptr timer;
+    if (timeout_us != (uint64_t)-1) {
+        FiberWaiter::ptr self = shared_from_this();
+        timer = iom_->addTimerUS(timeout_us, [self]() {
+            if (self->claim()) {
+                self->timeout_ = true;
+                self->iom_->Submit(self->fiber_);
+                self->iom_->endExternalWait();
+            }
+        });
+    }
+    Fiber::YieldToHold();
+    if (timer) {
+        timer->cancel();
+    }
+    return !timeout_;
+}
+
+bool FiberWaiter::cancel() {
+    if (claim()) {
+        iom_->endExternalWait();
+        return true;
+    }
+    Fiber::YieldToHold();
+    return false;
+}
+
+void FiberWaitQueue::add(const FiberWaiter::ptr &waiter) {
+    MutexType::Lock lock(mutex_);
+    waiters_.push_back(waiter);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    // 登记之后才重新检查条件, 与hasWaiters中的fence配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void FiberWaitQueue::remove(const FiberWaiter::ptr &waiter) {
+    MutexType::Lock lock(mutex_);
+    for (auto it = waiters_.begin(); it != waiters_.end(); ++it) {
+        if (*it == waiter) {
+            waiters_.erase(it);
+            count_.fetch_sub(1, std::memory_order_relaxed);
+            return;
+        }
+    }
+}
+
+bool FiberWaitQueue::notifyOne(const void *source) {
+    while (true) {
+        FiberWaiter::ptr waiter;
+        {
+            MutexType::Lock lock(mutex_);
+            if (waiters_.empty()) {
+                return false;
+            }
+            waiter = std::move(waiters_.front());
+            waiters_.pop_front();
+            count_.fetch_sub(1, std::memory_order_relaxed);
+        }
+        if (waiter->wake(source)) {
+            return true;
+        }
+    }
+}
+
+size_t FiberWaitQueue::notify(size_t count, const void *source) {
+    if (count == 1) {
+        return notifyOne(source) ? 1 : 0;
+    }
+    size_t woken = 0;
+    std::vector<FiberWaiter::ptr> waiters;
+    while (woken < count) {
+        {
+            MutexType::Lock lock(mutex_);
+            while (!waiters_.empty() && waiters.size() < count - woken) {
+                waiters.push_back(std::move(waiters_.front()));
+                waiters_.pop_front();
+                count_.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        if (waiters.empty()) {
+            break;
+        }
+        // 已经被其他队列唤醒或超时的等待者不算, 继续取
+        for (auto &waiter : waiters) {
+            if (waiter->wake(source)) {
+                ++woken;
+            }
+        }
+        waiters.clear();
+    }
+    return woken;
+}
+
+void FiberWaitQueue::notifyAll(const void *source) {
+    std::list<FiberWaiter::ptr> waiters;
+    {
+        MutexType::Lock lock(mutex_);
+        waiters.swap(waiters_);
+        count_.store(0, std::memory_order_relaxed);
+    }
+    for (auto &waiter : waiters) {
+        waiter->wake(source);
+    }
+}
+
 CoSemaphore::CoSemaphore(uint32_t count):num_(count), used_(0) {
 
 }
@@ -0,0 +1,105 @@
+#include "offload.h"
+#include "io_manager.h"
+#include "fiber.h"
+#include "log.h"
+#include "macro.h"
+namespace RPC {
+
+static Logger::ptr logger = RPC_LOG_ROOT();
+
+OffloadPool::OffloadPool(size_t threads, const std::string &name)
+    :threadCount_(threads ? threads : 1), name_(name) {
+}
+
+OffloadPool::~OffloadPool() {
+    stop();
+}
+
+OffloadPool* OffloadPool::GetDefault() {
+    static OffloadPool *pool = new OffloadPool;
+    return pool;
+}
+
+void OffloadPool::start() {
+    // 调用时持有mutex_
+    threads_.reserve(threadCount_);
+    for (size_t i = 0; i < threadCount_; ++i) {
+        threads_.push_back(std::make_shared<Thread>(name_ + "_" + std::to_string(i),
+                                                    std::bind(&OffloadPool::loop, this)));
+    }
+}
+
+void OffloadPool::run(std::function<void()> func) {
+    IOManager *iom = IOManager::GetThis();
+    if (!iom || Fiber::GetFiberId() == 0 || Fiber::GetThis()->isSharedStack()) {
+        func();
+        return;
+    }
+    Task task;
+    task.func = std::move(func);
+    task.fiber = Fiber::GetThis();
+    task.iom = iom;
+    {
+        MutexType::Lock lock(mutex_);
+        if (stopping_) {
+            lock.unlock();
+            task.func();
+            return;
+        }
+        if (threads_.empty()) {
+            start();
+        }
+        iom->beginExternalWait();
+        tasks_.push_back(std::move(task));
+    }
+    sem_.notify();
+    // 任务可能在切出之前完成, 调度器会把仍在执行的协程放回队列
+    Fiber::YieldToHold();
+}
+
+void OffloadPool::loop() {
+    while (true) {
+        sem_.wait();
+        Task task;
+        {
+            MutexType::Lock lock(mutex_);
+            if (tasks_.empty()) {
+                // stop()的唤醒
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        try {
+            task.func();
+        } catch (std::exception &ex) {
+            RPC_LOG_ERROR(logger) << "OffloadPool task exception: " << ex.what();
+        } catch (...) {
+            RPC_LOG_ERROR(logger) << "OffloadPool task unknown exception";
+        }
+        task.func = nullptr;
+        IOManager *iom = task.iom;
+        iom->Submit(std::move(task.fiber));
+        iom->endExternalWait();
+    }
+}
+
+void OffloadPool::stop() {
+    std::vector<Thread::ptr> threads;
+    {
+        MutexType::Lock lock(mutex_);
+        if (stopping_) {
+            return;
+        }
+        stopping_ = true;
+        threads.swap(threads_);
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+        sem_.notify();
+    }
+    for (auto &thread : threads) {
+        thread->join();
+    }
+}
+
+}
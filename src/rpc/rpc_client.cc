@@ -4,10 +4,11 @@
 namespace RPC {
 
 static RPC::Logger::ptr logger = RPC_LOG_ROOT();
-static uint64_t s_channel_capacity = 2;
+static uint64_t s_channel_capacity = 64;
+static size_t s_send_batch = 64;
 
 
-RPCClient::RPCClient(bool auto_heartbeat):sequence_id_(0), channel_(s_channel_capacity), timeout_ms_(-1), auto_heartbeat_(auto_heartbeat){
+RPCClient::RPCClient(bool auto_heartbeat):sequence_id_(0), channel_(s_channel_capacity), timeout_us_(-1), auto_heartbeat_(auto_heartbeat){
 
 }
 
@@ -28,14 +29,15 @@ bool RPCClient::connect(Address::ptr address) {
         return false;
     }
 
-    if (!sock->connect(address, timeout_ms_)) {
+    uint64_t connect_timeout = timeout_us_ == (uint64_t)-1 ? timeout_us_ : (timeout_us_ + 999) / 1000;
+    if (!sock->connect(address, connect_timeout)) {
         session_ = nullptr;
         return false;
     }
 
     session_ = std::make_shared<RPCSession>(sock);
     RPC_LOG_DEBUG(logger) << "server address" << *session_->getSocket();
-    channel_ = Channel<Protocol::ptr>(s_channel_capacity);
+    channel_ = MPMCChannel<Protocol::ptr>(s_channel_capacity);
     is_heartclose_ = false;
     is_closed_ = false;
     /*处理通道消息的接收和发送*/
@@ -86,18 +88,32 @@ void RPCClient::close() {
 
 void RPCClient::setTimeout(uint64_t timeout_ms) {
     MutexType::Lock lock(mutex_);
-    timeout_ms_ = timeout_ms;
+    timeout_us_ = timeout_ms == (uint64_t)-1 ? timeout_ms : timeout_ms * 1000;
+}
+
+void RPCClient::setTimeoutUS(uint64_t timeout_us) {
+    MutexType::Lock lock(mutex_);
+    timeout_us_ = timeout_us;
 }
 
 void RPCClient::handleSend() {
-    Protocol::ptr request;
-    while (channel_ >> request) {
-        if (!request) {
-            RPC_LOG_WARN(logger) << "RPCClient::handleSend() handle send fail";
-            continue;
+    std::vector<Protocol::ptr> requests;
+    // 一次取出通道中积攒的所有请求, 编码到一起用一次writev发送
+    while (channel_.popBatch(requests, s_send_batch)) {
+        size_t n = 0;
+        for (auto &request : requests) {
+            if (!request) {
+                RPC_LOG_WARN(logger) << "RPCClient::handleSend() handle send fail";
+                continue;
+            }
+            requests[n++] = std::move(request);
+        }
+        requests.resize(n);
+        if (n) {
+            RPC_LOG_DEBUG(logger) << "handle send " << n;
+            session_->sendResponses(requests);
         }
-        RPC_LOG_DEBUG(logger) << "handle send";
-        session_->sendResponse(request);
+        requests.clear();
     }
 }
 
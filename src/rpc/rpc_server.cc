@@ -7,8 +7,11 @@
 namespace RPC {
 static RPC::Logger::ptr logger = RPC_LOG_ROOT();
 static uint64_t s_heartbeat_timeout = 40000;
+static size_t s_offload_threads = 4;
 
 RPCServer::RPCServer(IOManager* worker, IOManager *acceptWorker):TCPServer(worker, acceptWorker), alive_time_(s_heartbeat_timeout), stop_clean_(false), clean_channel_(1) {
+    // 线程在第一次调用offload方法时才创建
+    offloadPool_ = std::make_shared<OffloadPool>(s_offload_threads, "rpc_offload");
 
 }
 RPCServer::~RPCServer() {
@@ -66,29 +69,21 @@ bool RPCServer::start() {
     return TCPServer::start();
 }
 
-void RPCServer::update(Timer::ptr &heartTimer, Socket::ptr client) {
-    if (!heartTimer) {
-        heartTimer = worker_->addTimer(alive_time_, [client]{
-            RPC_LOG_DEBUG(logger) << "client: "<< *client << " closed";
-            client->close();
-        });
-        return;
-    }
-    heartTimer->reset(alive_time_, true);
-}
-
 void RPCServer::handleClient(Socket::ptr client) {
     RPC_LOG_INFO(logger) << "handle client :" << *client;
     RPCSession::ptr session = std::make_shared<RPCSession>(client);
-    Timer::ptr heartTimer;
-    update(heartTimer, client);
+    // 超过alive_time_没有收到消息则关闭连接
+    IdleTimer::ptr idleTimer = IdleTimer::Create(worker_, alive_time_, [client]{
+        RPC_LOG_DEBUG(logger) << "client: "<< *client << " closed";
+        client->close();
+    });
     while(true) {
         Protocol::ptr request = session->recvRequest();
         if (request == nullptr) {
             break;
         }
         Protocol::ptr response;
-        update(heartTimer, client);
+        idleTimer->touch();
         // HEARTBEAT_PACKET,  //心跳包
         // RPC_REQUEST,       //RPC 通用请求包
         switch (request->getMsgType()) {
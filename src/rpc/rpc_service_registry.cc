@@ -19,9 +19,11 @@ void RPCServiceRegistry::handleClient(Socket::ptr client) {
     RPC_LOG_DEBUG(logger) << "handler client, client address: " << client;
     RPCSession::ptr session = std::make_shared<RPCSession> (client);
     Address::ptr providerAddr;
-    Timer::ptr heartbeat_timer;
-    /* 开启定时器任务*/
-    update(heartbeat_timer, client);
+    /* 开启定时器任务, 超过aliveTime_没有收到消息则关闭连接*/
+    IdleTimer::ptr idle_timer = IdleTimer::Create(worker_, aliveTime_, [client] {
+        RPC_LOG_INFO(logger) << "client: " << client << " closed";
+        client->close();
+    });
     while (true) {
         Protocol::ptr request = session->recvRequest();
         if (!request) {
@@ -31,7 +33,7 @@ void RPCServiceRegistry::handleClient(Socket::ptr client) {
             }
             return;
         }
-        update(heartbeat_timer, client);
+        idle_timer->touch();
         Protocol::MsgType type = request->getMsgType();
         Protocol::ptr response;
         switch (type) {
@@ -72,18 +74,6 @@ void RPCServiceRegistry::handleClient(Socket::ptr client) {
 }
 
 
-void RPCServiceRegistry::update(Timer::ptr &timer, Socket::ptr client) {
-    if (!timer) {
-        timer = worker_->addTimer(aliveTime_, [client] {
-            RPC_LOG_INFO(logger) << "client: " << client << " closed";
-            client->close();
-        });
-        return;
-    }
-    // 更新定时器时间
-    timer->reset(aliveTime_, true);
-}
-
 Protocol::ptr RPCServiceRegistry::handleHeartBeatPacket(Protocol::ptr request) {
     return Protocol::HeartBeat();
 }
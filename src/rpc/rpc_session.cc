@@ -40,4 +40,14 @@ int RPCSession::sendResponse(std::shared_ptr<Protocol> response) {
     return writeFixSize(ba, ba->getSize());
 }
 
+int RPCSession::sendResponses(const std::vector<std::shared_ptr<Protocol>> &responses) {
+    ByteArray::ptr ba(new ByteArray);
+    for (auto &response : responses) {
+        response->encode(ba);
+    }
+    ba->setPosition(0);
+    MutexType::Lock lock(mutex_);
+    return writeFixSize(ba, ba->getSize());
+}
+
 }
\ No newline at end of file
@@ -5,18 +5,46 @@
 #include "hook.h"
 #include <iostream>
 #include <signal.h>
+#include <algorithm>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 namespace RPC {
 
 static Logger::ptr logger = RPC_LOG_ROOT();
 static thread_local Scheduler* t_scheduler = nullptr; 
+/* 当前线程在所属调度器中的工作线程下标 */
+static thread_local int t_worker_index = -1;
+/* 全局环形队列的容量 */
+static const size_t s_inject_queue_capacity = 1024;
+/* 执行回调任务的协程栈大小 */
+static const size_t s_fiber_stack_size = 128 * 1024;
+/* 空闲线程休眠前默认的自旋次数 */
+static const uint32_t s_default_spin_count = 2000;
+static int FutexWait(std::atomic<uint32_t> *addr, uint32_t expected) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAIT_PRIVATE,
+                   expected, nullptr, nullptr, 0);
+}
+
+static int FutexWake(std::atomic<uint32_t> *addr, int count) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(addr), FUTEX_WAKE_PRIVATE,
+                   count, nullptr, nullptr, 0);
+}
 
 
 
 Scheduler::Scheduler(size_t threads, const std::string &name)
-:threadCount_(threads), activeThreads_(0), idleThreads_(0), name_(name){
+:threadCount_(threads), activeThreads_(0), idleThreads_(0), inject_(s_inject_queue_capacity),
+    overflowCount_(0), taskCount_(0), parkedThreads_(0), spinCount_(s_default_spin_count),
+    spins_(0), spinHits_(0), parks_(0), wakeups_(0), numaAware_(false), nodeCursor_(0), name_(name){
     stop_ = true;
     t_scheduler = this;
-
+    workers_.resize(threadCount_);
+    for (size_t i = 0; i < threadCount_; ++i) {
+        workers_[i].reset(new Worker);
+        workers_[i]->index = i;
+    }
 }
 
 Scheduler::~Scheduler() {
@@ -37,11 +65,17 @@ void Scheduler::Start() {
     RPC_ASSERT(threads_.empty());
     threadIds_.resize(threadCount_);
     threads_.resize(threadCount_);
+    PlaceWorkers();
     for (size_t i = 0; i < threadCount_; ++i) {
-        threads_[i].reset(new RPC::Thread(name_+"_"+std::to_string(i), [this]{
+        threads_[i].reset(new RPC::Thread(name_+"_"+std::to_string(i), [this, i]{
+            t_worker_index = i;
+            if (!workers_[i]->cpus.empty()) {
+                Thread::SetAffinity(workers_[i]->cpus);
+            }
             this->Run();
         }));
         threadIds_[i] = threads_[i]->getId();
+        workers_[i]->threadId = threadIds_[i];
     }
 }
 
@@ -57,9 +91,286 @@ void Scheduler::Stop() {
     }
 }
 
+void Scheduler::setCpuAffinity(const std::vector<int> &cpus) {
+    MutexType::Lock lock(mutex_);
+    cpus_ = cpus;
+    if (!stop_) {
+        ApplyPlacement();
+    }
+}
+
+void Scheduler::setNumaAware(bool v) {
+    MutexType::Lock lock(mutex_);
+    numaAware_ = v;
+    if (!stop_) {
+        ApplyPlacement();
+    }
+}
+
+void Scheduler::ApplyPlacement() {
+    for (auto &worker : workers_) {
+        worker->node = 0;
+        worker->cpus.clear();
+    }
+    PlaceWorkers();
+    for (size_t i = 0; i < threads_.size(); ++i) {
+        // cpus为空时解除绑定
+        threads_[i]->setAffinity(workers_[i]->cpus);
+    }
+}
+
+void Scheduler::PlaceWorkers() {
+    if (!numaAware_ && cpus_.empty()) {
+        return;
+    }
+    std::vector<std::vector<int>> nodes;
+    // 每个节点的系统编号, 过滤掉节点后编号不连续, 不能用下标代替
+    std::vector<int> ids;
+    if (numaAware_) {
+        nodes = GetNumaNodeCpus(&ids);
+        if (!cpus_.empty()) {
+            // 只保留指定的CPU
+            std::vector<std::vector<int>> filtered;
+            std::vector<int> filtered_ids;
+            for (size_t i = 0; i < nodes.size(); ++i) {
+                std::vector<int> cpus;
+                for (int cpu : nodes[i]) {
+                    if (std::find(cpus_.begin(), cpus_.end(), cpu) != cpus_.end()) {
+                        cpus.push_back(cpu);
+                    }
+                }
+                if (!cpus.empty()) {
+                    filtered.push_back(std::move(cpus));
+                    filtered_ids.push_back(ids[i]);
+                }
+            }
+            nodes.swap(filtered);
+            ids.swap(filtered_ids);
+        }
+    }
+    if (nodes.empty()) {
+        nodes.push_back(cpus_);
+        ids.assign(1, 0);
+    }
+    std::vector<size_t> used(nodes.size(), 0);
+    for (size_t i = 0; i < threadCount_; ++i) {
+        Worker *worker = workers_[i].get();
+        // 连续的线程分到同一个节点
+        size_t node = i * nodes.size() / threadCount_;
+        worker->node = ids[node];
+        if (!cpus_.empty()) {
+            // 指定了CPU时每个线程绑定一个CPU
+            worker->cpus.assign(1, nodes[node][used[node]++ % nodes[node].size()]);
+        } else {
+            worker->cpus = nodes[node];
+        }
+    }
+}
+
+int Scheduler::getThreadNode(int thread) {
+    Worker *worker = FindWorker(thread);
+    return worker ? worker->node.load() : -1;
+}
+
+int Scheduler::pickThreadOnNode(int node) {
+    size_t n = workers_.size();
+    size_t start = nodeCursor_++;
+    for (size_t i = 0; i < n; ++i) {
+        Worker *worker = workers_[(start + i) % n].get();
+        if (worker->node == node && worker->threadId != -1) {
+            return worker->threadId;
+        }
+    }
+    return -1;
+}
+
+int Scheduler::getWorkerIndex() {
+    Worker *worker = GetWorker();
+    return worker ? (int)worker->index : -1;
+}
+
+Scheduler::Worker* Scheduler::GetWorker() {
+    if (t_scheduler != this || t_worker_index < 0) {
+        return nullptr;
+    }
+    return workers_[t_worker_index].get();
+}
+
+Scheduler::Worker* Scheduler::FindWorker(int thread) {
+    for (auto &worker : workers_) {
+        if (worker->threadId == thread) {
+            return worker.get();
+        }
+    }
+    return nullptr;
+}
+
+bool Scheduler::SubmitTask(ScheduleTask &task) {
+    Worker *self = GetWorker();
+    ++taskCount_;
+    if (task.thread != -1) {
+        Worker *target = FindWorker(task.thread);
+        if (target) {
+            Worker::MutexType::Lock lock(target->mutex);
+            target->inbox.push_back(std::move(task));
+            ++target->inboxSize;
+            lock.unlock();
+            // 指定给其他线程的任务只能由该线程执行, 只唤醒该线程
+            if (target == self) {
+                return false;
+            }
+            return !NotifyWorker(target->index);
+        }
+        RPC_LOG_WARN(logger) << "Scheduler::Submit thread=" << task.thread
+            << " not belong to scheduler " << name_ << ", run on any thread";
+        task.thread = -1;
+    }
+    // 可以被任何线程执行的任务, 由Notify判断是否有空闲的线程需要唤醒
+    if (self) {
+        Worker::MutexType::Lock lock(self->mutex);
+        self->tasks.push_back(std::move(task));
+        ++self->stealable;
+        return true;
+    }
+    PushGlobal(task);
+    return true;
+}
+
+bool Scheduler::SubmitTasks(std::vector<ScheduleTask> &tasks) {
+    Worker *self = GetWorker();
+    taskCount_ += tasks.size();
+    bool need_notify = false;
+    size_t local = 0;
+    for (auto &task : tasks) {
+        if (task.thread != -1) {
+            Worker *target = FindWorker(task.thread);
+            if (target) {
+                Worker::MutexType::Lock lock(target->mutex);
+                target->inbox.push_back(std::move(task));
+                ++target->inboxSize;
+                lock.unlock();
+                if (target != self && !NotifyWorker(target->index)) {
+                    need_notify = true;
+                }
+                continue;
+            }
+            RPC_LOG_WARN(logger) << "Scheduler::SubmitBatch thread=" << task.thread
+                << " not belong to scheduler " << name_ << ", run on any thread";
+            task.thread = -1;
+        }
+        if (self) {
+            // 先集中到数组前部, 稍后一次加锁放入本线程队列
+            if (&tasks[local] != &task) {
+                tasks[local] = std::move(task);
+            }
+            ++local;
+        } else {
+            PushGlobal(task);
+            need_notify = true;
+        }
+    }
+    if (local > 0) {
+        Worker::MutexType::Lock lock(self->mutex);
+        for (size_t i = 0; i < local; ++i) {
+            self->tasks.push_back(std::move(tasks[i]));
+        }
+        self->stealable += local;
+        // 放入本线程队列的任务也可以被空闲的线程窃取
+        need_notify = true;
+    }
+    return need_notify;
+}
+
+void Scheduler::PushGlobal(ScheduleTask &task) {
+    if (inject_.push(std::move(task))) {
+        return;
+    }
+    MutexType::Lock lock(mutex_);
+    tasks_.push_back(std::move(task));
+    ++overflowCount_;
+}
+
+bool Scheduler::PopGlobal(ScheduleTask &task) {
+    if (inject_.pop(task)) {
+        return true;
+    }
+    if (overflowCount_ == 0) {
+        return false;
+    }
+    MutexType::Lock lock(mutex_);
+    if (tasks_.empty()) {
+        return false;
+    }
+    task = std::move(tasks_.front());
+    tasks_.pop_front();
+    --overflowCount_;
+    return true;
+}
+
+bool Scheduler::NextTask(Worker *worker, ScheduleTask &task) {
+    {
+        Worker::MutexType::Lock lock(worker->mutex);
+        if (!worker->inbox.empty()) {
+            task = std::move(worker->inbox.front());
+            worker->inbox.pop_front();
+            --worker->inboxSize;
+        } else if (!worker->tasks.empty()) {
+            task = std::move(worker->tasks.back());
+            worker->tasks.pop_back();
+            --worker->stealable;
+        }
+    }
+    if (!task && !PopGlobal(task) && !StealTask(worker, task)) {
+        return false;
+    }
+    if (task.fiber && task.fiber->GetState() == Fiber::EXEC) {
+        // 协程还没有切出(提交者比协程切出更快), 放回队列稍后再执行
+        Worker::MutexType::Lock lock(worker->mutex);
+        if (task.thread != -1) {
+            worker->inbox.push_back(std::move(task));
+            ++worker->inboxSize;
+        } else {
+            worker->tasks.push_front(std::move(task));
+            ++worker->stealable;
+        }
+        task.Reset();
+        return false;
+    }
+    --taskCount_;
+    return true;
+}
+
+bool Scheduler::StealTask(Worker *worker, ScheduleTask &task) {
+    static thread_local uint32_t t_seed = GetThreadId();
+    size_t n = workers_.size();
+    // xorshift 随机选择起始的线程, 避免所有空闲线程都从同一个线程窃取
+    t_seed ^= t_seed << 13;
+    t_seed ^= t_seed >> 17;
+    t_seed ^= t_seed << 5;
+    size_t start = t_seed % n;
+    // 开启NUMA分组时先窃取同节点的线程, 再跨节点窃取
+    for (int pass = numaAware_ ? 0 : 1; pass < 2; ++pass) {
+        for (size_t i = 0; i < n; ++i) {
+            Worker *victim = workers_[(start + i) % n].get();
+            if (victim == worker || victim->stealable == 0
+                || (pass == 0 && victim->node != worker->node)) {
+                continue;
+            }
+            Worker::MutexType::Lock lock(victim->mutex);
+            if (!victim->tasks.empty()) {
+                task = std::move(victim->tasks.front());
+                victim->tasks.pop_front();
+                --victim->stealable;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 void Scheduler::Run() {
     /**
-     * @brief 协程调度函数，线程从任务队列中取出任务
+     * @brief 协程调度函数，线程依次从自己的队列, 全局队列取出任务, 没有任务时窃取其他线程的任务
      * 
      * 
      */
@@ -67,35 +378,26 @@ void Scheduler::Run() {
     signal(SIGPIPE, SIG_IGN);
     SetThis();
     RPC::Fiber::EnableFiber();
-    Fiber::ptr fiber;
+    Worker *worker = GetWorker();
+    RPC_ASSERT(worker);
+    worker->threadId = GetThreadId();
+    Fiber::ptr cb_fiber;
+    // 共享栈模式的回调任务复用的协程
+    Fiber::ptr shared_fiber;
     Fiber::ptr idle_fiber (new Fiber(std::bind(&Scheduler::Wait, this)));
+    // 回调协程入口先把待执行的回调移到自己栈上, 之后本线程可以继续放入下一个回调
+    // runner只捕获一个引用, std::function不会为它分配内存
+    InlineFunction pending;
+    std::function<void()> runner = [&pending]() {
+        InlineFunction func(std::move(pending));
+        func();
+    };
     ScheduleTask task;
     while (!stop_) {
         task.Reset();
-        //是否通知有任务
-        bool tickle = false;
-        {
-            MutexType::Lock lock(mutex_);
-            auto it = tasks_.begin();
-            for (it = tasks_.begin(); it != tasks_.end(); ++it) {
-                if (it->thread != -1 && it->thread != GetThreadId()) {
-                    // 拿到的协程有指定线程进行执行，且不是当前线程
-                    tickle = true;
-                    continue;
-                }
-                RPC_ASSERT(*it); 
-                if (it->fiber && it->fiber->GetState() == Fiber::EXEC) {
-                    continue;   
-                }
-                task = *it;
-                tasks_.erase(it);
-                break;
-            }
-            if (it != tasks_.end()) {
-                tickle = true;
-            }
-        }
-        if (tickle) {
+        NextTask(worker, task);
+        // 还有其他线程能取到的任务时通知空闲的线程, 指定给某个线程的任务在提交时已经通知过
+        if (hasIdleThreads() && HasSharedWork()) {
             Notify();
         }
 
@@ -104,22 +406,26 @@ void Scheduler::Run() {
             // 进行协程任务调度
             task.fiber->Resume();
             --activeThreads_;
+            onFiberYield();
             // 调度完协程还未结束 重新加入队列
             if(task.fiber->GetState() == Fiber::READY) {
                 Submit(task.fiber);
             }
             task.Reset();
         } else if (task.func) {
+            Fiber::ptr &fiber = task.sharedStack ? shared_fiber : cb_fiber;
+            pending = std::move(task.func);
             if (fiber) {
-                fiber->Reset(task.func);
+                fiber->Reset(runner);
             } else {
-                fiber.reset(new Fiber(task.func));
+                fiber.reset(new Fiber(runner, s_fiber_stack_size, task.sharedStack));
             }
             task.Reset();
             //调度协程
             ++activeThreads_;
             fiber->Resume();
             --activeThreads_;
+            onFiberYield();
             if (fiber->GetState() == Fiber::READY) {
                 Submit(fiber);
                 fiber.reset();
@@ -152,8 +458,7 @@ void Scheduler::SetThis() {
 }
 
 bool Scheduler::Stopping() {
-    MutexType::Lock lock(mutex_);
-    return stop_ && tasks_.empty() && activeThreads_ == 0;
+    return stop_ && taskCount_ == 0 && activeThreads_ == 0;
 }
 
     /**
@@ -162,18 +467,119 @@ bool Scheduler::Stopping() {
      */
 
 void Scheduler::Wait() {
-    RPC_LOG_INFO(logger) << "idle";
+    RPC_LOG_DEBUG(logger) << "idle";
+    Worker *worker = GetWorker();
     while (!Stopping()) {
+        // 只看本线程能取到的任务, 其他线程inbox中积压的任务不会让本线程空转
+        if (worker && !HasWork(worker)) {
+            // 先自旋一段时间, 短时间内有新任务时不用进入内核
+            uint32_t spin = spinCount_;
+            bool found = false;
+            if (spin > 0) {
+                ++spins_;
+                for (uint32_t i = 0; i < spin && !stop_; ++i) {
+                    if (HasWork(worker)) {
+                        found = true;
+                        break;
+                    }
+                    CpuRelax();
+                }
+                if (found) {
+                    ++spinHits_;
+                }
+            }
+            if (!found && !stop_) {
+                Park(worker);
+            }
+        }
         RPC::Fiber::YieldToHold();
     }
     RPC_LOG_DEBUG(logger) << "idle fiber exit";
 
 }
 
+bool Scheduler::hasRunnableTask() {
+    Worker *worker = GetWorker();
+    return worker && HasWork(worker);
+}
+
+bool Scheduler::HasWork(Worker *worker) {
+    return worker->inboxSize > 0 || HasSharedWork();
+}
+
+bool Scheduler::HasSharedWork() {
+    if (inject_.size() > 0 || overflowCount_ > 0) {
+        return true;
+    }
+    for (auto &worker : workers_) {
+        if (worker->stealable > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 不会丢失唤醒:
+ *  休眠方: parked = 1, ++parkedThreads_, fence, 检查HasWork, 没有任务才FutexWait(parked, 1)
+ *  共享任务的提交方: 放入本线程队列或全局队列, fence, 检查parkedThreads_ (Notify)
+ *  两边都是先写后读并用seq_cst隔开, 至少有一方能看到另一方的写入: 要么休眠方看到任务不休眠,
+ *  要么提交方看到parkedThreads_ > 0, 把某个休眠线程的parked从1改为0再FUTEX_WAKE.
+ *  指定线程的任务: 提交方在目标线程的锁内增加inboxSize, 再对目标线程的parked做CAS, 同样配对.
+ *  FutexWait只在parked仍为1时休眠, 唤醒先于休眠发生时直接返回; 被唤醒的线程取到任务后
+ *  如果还有共享任务会继续唤醒下一个线程. Stop时先设置stop_再对每个线程Notify, 休眠前也检查stop_
+ */
+void Scheduler::Park(Worker *worker) {
+    worker->parked = 1;
+    ++parkedThreads_;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!HasWork(worker) && !stop_) {
+        ++parks_;
+        while (worker->parked.load() == 1) {
+            FutexWait(&worker->parked, 1);
+        }
+    }
+    worker->parked = 0;
+    --parkedThreads_;
+}
+
+bool Scheduler::Unpark(Worker *worker) {
+    uint32_t expected = 1;
+    if (!worker->parked.compare_exchange_strong(expected, 0)) {
+        return false;
+    }
+    ++wakeups_;
+    FutexWake(&worker->parked, 1);
+    return true;
+}
+
+bool Scheduler::NotifyWorker(size_t index) {
+    // 目标线程没有休眠时, 休眠前会看到inbox中的任务, 不需要再唤醒其他线程
+    Unpark(workers_[index].get());
+    return true;
+}
+
 void Scheduler::Notify() {
-    RPC_LOG_INFO(logger) << "notify";
-    //TODO notify action
+    // 与Park中的fence配对, 任务入队之后才检查是否有休眠的线程
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (parkedThreads_ == 0) {
+        return;
+    }
+    // 只唤醒一个休眠的线程, 该线程取到任务后如果还有剩余任务会继续通知
+    for (auto &worker : workers_) {
+        if (Unpark(worker.get())) {
+            return;
+        }
+    }
+}
 
+Scheduler::IdleStats Scheduler::getIdleStats() const {
+    IdleStats stats;
+    stats.spins = spins_;
+    stats.spinHits = spinHits_;
+    stats.parks = parks_;
+    stats.wakeups = wakeups_;
+    return stats;
 }
 
 
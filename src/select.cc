@@ -0,0 +1,173 @@
+#include "select.h"
+#include "hook.h"
+#include "utils.h"
+#include <poll.h>
+namespace RPC {
+
+// 句柄的同一方向已经有其他等待者时重新检查的间隔(微秒)
+static const uint64_t s_event_recheck_us = 10 * 1000;
+
+/**
+ * @brief 等待句柄事件的case, 注册到IOManager的回调唤醒协程
+ *  回调只持有waiter和触发标志, 不访问case本身, 触发晚于Select析构也没有问题
+ */
+class Select::EventCase : public Case {
+public:
+    EventCase(int fd, IOManager::Event event):fd_(fd), event_(event) {}
+
+    bool tryRun(bool &ok) override {
+        if (failed_) {
+            // 注册失败(如句柄超出范围), 当作完成返回给调用者
+            failed_ = false;
+            ok = false;
+            return true;
+        }
+        pollfd pfd;
+        pfd.fd = fd_;
+        pfd.events = event_ == IOManager::READ ? POLLIN : POLLOUT;
+        pfd.revents = 0;
+        if (poll_f(&pfd, 1, 0) <= 0) {
+            return false;
+        }
+        ok = !(pfd.revents & POLLNVAL);
+        return true;
+    }
+
+    void add(const FiberWaiter::ptr &waiter) override {
+        iom_ = IOManager::GetThis();
+        fired_ = std::make_shared<std::atomic<bool>>(false);
+        std::shared_ptr<std::atomic<bool>> fired = fired_;
+        const void *source = this;
+        IOManager::AddEventResult rt = iom_->tryAddEvent(fd_, event_, [waiter, fired, source]() {
+                fired->store(true);
+                waiter->wake(source);
+            }, this);
+        if (rt == IOManager::ADD_OK) {
+            return;
+        }
+        fired_ = nullptr;
+        if (rt == IOManager::ADD_READY) {
+            // 常驻注册记录的边沿已经到达, 不挂起, 由tryRun重新检查
+            waiter->wake(source);
+        } else if (rt == IOManager::ADD_BUSY) {
+            // 其他协程在等待同一个句柄的同一方向, 定时唤醒重新检查
+            timer_ = iom_->addTimerUS(s_event_recheck_us, [waiter, source]() {
+                waiter->wake(source);
+            });
+        } else {
+            failed_ = true;
+        }
+    }
+
+    void remove(const FiberWaiter::ptr &waiter) override {
+        // 已经触发的事件已从IOManager中移除, 只移除自己的注册
+        if (fired_ && !fired_->load()) {
+            iom_->removeEvent(fd_, event_, this);
+        }
+        fired_ = nullptr;
+        if (timer_) {
+            timer_->cancel();
+            timer_ = nullptr;
+        }
+    }
+
+    const void *getSource() const override { return this; }
+
+private:
+    int fd_;
+    IOManager::Event event_;
+    IOManager *iom_ = nullptr;
+    std::shared_ptr<std::atomic<bool>> fired_;
+    Timer::ptr timer_;
+    bool failed_ = false;
+};
+
+Select::Select() {
+}
+
+Select::~Select() {
+}
+
+int Select::event(int fd, IOManager::Event event) {
+    return addCase(new EventCase(fd, event));
+}
+
+int Select::addCase(Case *c) {
+    cases_.emplace_back(c);
+    return (int)cases_.size() - 1;
+}
+
+int Select::tryCases(size_t start) {
+    size_t n = cases_.size();
+    for (size_t i = 0; i < n; ++i) {
+        size_t index = (start + i) % n;
+        if (cases_[index]->tryRun(ok_)) {
+            return (int)index;
+        }
+    }
+    return TIMEOUT;
+}
+
+void Select::passOn(const void *source, int index) {
+    if (!source || cases_[index]->getSource() == source) {
+        return;
+    }
+    for (auto &c : cases_) {
+        if (c->getSource() == source) {
+            c->renotify();
+            return;
+        }
+    }
+}
+
+int Select::wait(uint64_t timeout_us) {
+    uint64_t deadline = timeout_us == (uint64_t)-1 ? timeout_us : GetMonotonicUS() + timeout_us;
+    size_t start = cases_.empty() ? 0 : next_++ % cases_.size();
+    // 上一次唤醒的来源
+    const void *source = nullptr;
+    while (true) {
+        int index = tryCases(start);
+        if (index != TIMEOUT) {
+            passOn(source, index);
+            return index;
+        }
+        uint64_t timeout = (uint64_t)-1;
+        if (deadline != (uint64_t)-1) {
+            uint64_t now = GetMonotonicUS();
+            if (now >= deadline) {
+                return TIMEOUT;
+            }
+            timeout = deadline - now;
+        }
+
+        FiberWaiter::ptr waiter = std::make_shared<FiberWaiter>();
+        for (auto &c : cases_) {
+            c->add(waiter);
+        }
+        // 登记之后重新检查, 期间对端操作时可能还没有看到登记
+        index = tryCases(start);
+        if (index != TIMEOUT) {
+            for (auto &c : cases_) {
+                c->remove(waiter);
+            }
+            if (!waiter->cancel()) {
+                passOn(waiter->getSource(), index);
+            }
+            return index;
+        }
+        waiter->park(timeout);
+        for (auto &c : cases_) {
+            c->remove(waiter);
+        }
+        // 超时时source为空, 否则先检查唤醒协程的case
+        source = waiter->getSource();
+        for (size_t i = 0; i < cases_.size(); ++i) {
+            if (cases_[i]->getSource() == source) {
+                start = i;
+                break;
+            }
+        }
+    }
+}
+
+}
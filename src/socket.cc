@@ -64,10 +64,26 @@ bool Socket::getOption(int level, int optname, void* result, size_t* len) {
 }
 
 void Socket::setSendTimeout(uint64_t time) {
-    struct timeval tv = {int(time/1000), int(time % 1000 *1000)};;
-    setOption(SOL_SOCKET, SO_SNDTIMEO, &tv);
+    setSendTimeoutUS(time * 1000);
 }
 uint64_t Socket::getSendTimeout() const {
+    uint64_t us = getSendTimeoutUS();
+    return us == (uint64_t)-1 ? us : us / 1000;
+}
+
+void Socket::setRecvTimeout(uint64_t time) {
+    setRecvTimeoutUS(time * 1000);
+}
+uint64_t Socket::getRecvTimeout() {
+    uint64_t us = getRecvTimeoutUS();
+    return us == (uint64_t)-1 ? us : us / 1000;
+}
+
+void Socket::setSendTimeoutUS(uint64_t us) {
+    struct timeval tv = {long(us / 1000000), long(us % 1000000)};
+    setOption(SOL_SOCKET, SO_SNDTIMEO, &tv);
+}
+uint64_t Socket::getSendTimeoutUS() const {
     FdContext::ptr fdctx = RPC::FdMgr::GetInstance()->getFdContext(fd_);
     if (!fdctx) {
         RPC_LOG_DEBUG(logger) << "fdContext is not exist";
@@ -76,11 +92,11 @@ uint64_t Socket::getSendTimeout() const {
     return fdctx->getTimeout(SO_SNDTIMEO);
 }
 
-void Socket::setRecvTimeout(uint64_t time) {
-    struct timeval tv = {int(time/1000), int(time % 1000 *1000)};;
+void Socket::setRecvTimeoutUS(uint64_t us) {
+    struct timeval tv = {long(us / 1000000), long(us % 1000000)};
     setOption(SOL_SOCKET, SO_RCVTIMEO, &tv);
 }
-uint64_t Socket::getRecvTimeout() {
+uint64_t Socket::getRecvTimeoutUS() {
     FdContext::ptr fdctx = RPC::FdMgr::GetInstance()->getFdContext(fd_);
     if (!fdctx) {
         RPC_LOG_DEBUG(logger) << "fdContext is not exist";
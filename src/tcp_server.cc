@@ -8,7 +8,8 @@ static RPC::Logger::ptr logger = RPC_LOG_ROOT();
 TCPServer::TCPServer(RPC::IOManager* worker, IOManager *accpetWorker)
     :worker_(worker),
     acceptWorker_(accpetWorker),
-    stop_(true)
+    stop_(true),
+    sharedStack_(false)
 {
 
 }
@@ -56,7 +57,12 @@ void TCPServer::startAccept(Socket::ptr sock) {
         Socket::ptr client = sock->accept();
         if (client) {
             RPC_LOG_DEBUG(logger) << "accept sucess, socket=" << *client;
-            worker_->Submit(std::bind(&TCPServer::handleClient, shared_from_this(), client));
+            int thread = -1;
+            if (worker_->isNumaAware()) {
+                // 连接交给接收它的NUMA节点上的线程处理
+                thread = worker_->pickThreadOnNode(GetCurrentNumaNode());
+            }
+            worker_->Submit(std::bind(&TCPServer::handleClient, shared_from_this(), client), thread, sharedStack_);
         } else {
             RPC_LOG_ERROR(logger) << "accept error, errno=" << errno << " errstr=" 
             << strerror(errno);
@@ -1,8 +1,13 @@
 #include "thread.h"
 #include "utils.h"
+#include "log.h"
 #include <exception>
+#include <sched.h>
+#include <unistd.h>
+#include <string.h>
 namespace RPC {
 
+static Logger::ptr logger = RPC_LOG_ROOT();
 static thread_local Thread * t_thread = nullptr;
 static thread_local std::string t_thread_name = "UNKNOWN";
 Thread::Thread(const std::string &name, std::function<void()> cb):name_(name) {
@@ -57,6 +62,39 @@ void Thread::SetName(const std::string& name) {
     t_thread_name = name;
 }
 
+/**
+ * @brief 把线程绑定到CPU集合上, cpus为空时使用所有CPU
+ */
+static bool SetThreadAffinity(pthread_t thread, const std::string &name, const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (cpus.empty()) {
+        long count = sysconf(_SC_NPROCESSORS_CONF);
+        for (long cpu = 0; cpu < count && cpu < CPU_SETSIZE; ++cpu) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    int rt = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (rt) {
+        RPC_LOG_ERROR(logger) << "pthread_setaffinity_np fail, thread=" << name
+            << " rt=" << rt << " errstr=" << strerror(rt);
+        return false;
+    }
+    return true;
+}
+
+bool Thread::SetAffinity(const std::vector<int> &cpus) {
+    return SetThreadAffinity(pthread_self(), getName(), cpus);
+}
+
+bool Thread::setAffinity(const std::vector<int> &cpus) {
+    return SetThreadAffinity(thread_, name_, cpus);
+}
 
 const std::string& Thread::getName() {
     if (t_thread) {
@@ -1,94 +1,320 @@
 #include "timer.h"
 #include "utils.h"
+#include <string.h>
+#include <algorithm>
 namespace RPC {
-Timer::Timer(uint64_t ms, std::function<void()> callback, bool recurring, TimerManager *manager) 
-    :ms_(ms), callback_(callback), recurring_(recurring), manager_(manager)
+Timer::Timer(uint64_t us, std::function<void()> callback, bool recurring, TimerManager *manager) 
+    :us_(us), callback_(callback), recurring_(recurring), manager_(manager), wheel_(nullptr),
+    level_(-1), slot_(0)
 {
-    next_ = GetCurrentMS() + ms;
+    next_ = GetCachedUS() + us;
 }
-Timer::Timer(uint64_t next):next_(next) {
 
+TimerWheel* Timer::lockWheel() {
+    while (true) {
+        TimerWheel *wheel = wheel_.load(std::memory_order_acquire);
+        wheel->mutex().lock();
+        if (wheel == wheel_.load(std::memory_order_relaxed)) {
+            return wheel;
+        }
+        wheel->mutex().unlock();
+    }
+}
+
+void Timer::moveToCurrent(TimerWheel *wheel) {
+    TimerWheel *current = manager_->currentWheel();
+    if (current == wheel) {
+        if (level_ >= 0) {
+            wheel->relink(this);
+        } else {
+            wheel->link(shared_from_this());
+        }
+        bool at_front = current == manager_->wheels_.back().get() && wheel->updateNearest(next_);
+        wheel->mutex().unlock();
+        if (at_front) {
+            manager_->onTimerInsertedAtFront();
+        }
+        return;
+    }
+    // 不同时持有两个时间轮的锁, 先摘除再放入, 期间被取消或再次移动时放弃
+    Timer::ptr self = shared_from_this();
+    if (level_ >= 0) {
+        wheel->unlink(this);
+    }
+    wheel_ = current;
+    wheel->mutex().unlock();
+    TimerWheel::MutexType::Lock lock(current->mutex());
+    if (wheel_ != current || !callback_ || level_ >= 0) {
+        return;
+    }
+    current->link(self);
+    bool at_front = current == manager_->wheels_.back().get() && current->updateNearest(next_);
+    lock.unlock();
+    if (at_front) {
+        manager_->onTimerInsertedAtFront();
+    }
 }
 
 bool Timer::cancel() {
-    TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
+    TimerWheel *wheel = lockWheel();
+    // 槽中的引用可能是最后一个引用, 解锁之后再释放
+    Timer::ptr self;
+    bool cancelled = false;
     if (callback_) {
         callback_ = nullptr;
-        auto it = manager_->timers_.find(shared_from_this());
-        manager_->timers_.erase(it);
-        return true;
+        cancelled = true;
+        if (level_ >= 0) {
+            self = shared_from_this();
+            wheel->unlink(this);
+        }
     }
-
-    return false;
-
+    wheel->mutex().unlock();
+    return cancelled;
 }
 bool Timer::refresh() {
-    TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
-    if (!callback_) {
+    TimerWheel *wheel = lockWheel();
+    if (!callback_ || level_ < 0) {
+        wheel->mutex().unlock();
         return false;
     }
-    auto it = manager_->timers_.find(shared_from_this());
-    if (it == manager_->timers_.end()) {
-        return false;
-    }
-    manager_->timers_.erase(it);
-    next_ = GetCurrentMS() + ms_;
-    manager_->timers_.insert(shared_from_this());
+    next_ = GetCachedUS() + us_;
+    moveToCurrent(wheel);
     return true;
 }
 bool Timer::reset(uint64_t ms, bool from_now) {
-    if (ms_ == ms && !from_now) {
+    return resetUS(ms * 1000, from_now);
+}
+bool Timer::resetUS(uint64_t us, bool from_now) {
+    if (us_ == us && !from_now) {
         return true;
     }
-    TimerManager::RWMutexType::WriteLock lock(manager_->mutex_);
+    TimerWheel *wheel = lockWheel();
     if (!callback_) {
+        wheel->mutex().unlock();
         return false;
     }
-    auto it = manager_->timers_.find(shared_from_this());
-    if (it != manager_->timers_.end()) {
-        manager_->timers_.erase(it); 
-    }
     uint64_t start = 0;
     if (from_now) {
-        start = GetCurrentMS();
+        start = GetCachedUS();
     } else {
-        start = next_ - ms;
+        start = next_ - us_;
     }
-    ms_ = ms;
-    next_ = start + ms;
-    manager_->addTimer(shared_from_this(), lock);
+    us_ = us;
+    next_ = start + us;
+    moveToCurrent(wheel);
     return true;
 }
 
-bool Timer::Comparator::operator() (const Timer::ptr &lhs, const Timer::ptr &rhs) const {
-    if (lhs->next_ < rhs->next_) {
-        return true;
+TimerWheel::TimerWheel()
+    :current_(GetCachedMS()), count_(0), due_(~0ull), nearest_(~0ull) {
+    memset(rootBitmap_, 0, sizeof(rootBitmap_));
+}
+
+void TimerWheel::advance(uint64_t now, std::list<Timer::ptr> &expired) {
+    uint64_t now_ms = now / 1000;
+    while (current_ < now_ms) {
+        if (count_ == 0) {
+            current_ = now_ms;
+            break;
+        }
+        if (rootEmpty()) {
+            // 第0层没有定时器, 直接跳到下一次下放的时间
+            uint64_t boundary = (current_ + ROOT_SIZE) & ~(uint64_t)(ROOT_SIZE - 1);
+            if (boundary > now_ms) {
+                current_ = now_ms;
+                break;
+            }
+            current_ = boundary;
+            cascade();
+            continue;
+        }
+        // 已经过去的毫秒, 整个槽都到期
+        expireSlot(~0ull, expired);
+        if ((++current_ & (ROOT_SIZE - 1)) == 0) {
+            cascade();
+        }
     }
-    if (rhs->next_ < lhs->next_) {
-        return false;
+    if (count_ > 0) {
+        expireSlot(now, expired);
+    }
+    due_ = count_ > 0 ? nextExpire() : ~0ull;
+}
+
+std::list<Timer::ptr>& TimerWheel::bucket(int level, uint32_t slot) {
+    if (level == 0) {
+        return root_[slot];
+    }
+    return wheels_[level - 1][slot];
+}
+
+std::list<Timer::ptr>& TimerWheel::locate(Timer *timer) {
+    uint64_t expire = timer->next_ / 1000;
+    if (expire < current_) {
+        // 已经到期, 放在正在处理的槽
+        expire = current_;
+    }
+    uint64_t delta = expire - current_;
+    if (delta < ROOT_SIZE) {
+        timer->level_ = 0;
+        timer->slot_ = expire & (ROOT_SIZE - 1);
+        rootBitmap_[timer->slot_ / 64] |= 1ull << (timer->slot_ % 64);
+        return root_[timer->slot_];
+    }
+    static const uint64_t s_max_delta = (1ull << (ROOT_BITS + WHEEL_LEVELS * WHEEL_BITS)) - 1;
+    if (delta > s_max_delta) {
+        // 超出时间轮的跨度, 先放在最高层最远的槽, 下放时重新计算
+        expire = current_ + s_max_delta;
+        delta = s_max_delta;
+    }
+    int level = 1;
+    while (level < WHEEL_LEVELS && delta >= (1ull << (ROOT_BITS + level * WHEEL_BITS))) {
+        ++level;
+    }
+    timer->level_ = level;
+    timer->slot_ = (expire >> (ROOT_BITS + (level - 1) * WHEEL_BITS)) & (WHEEL_SIZE - 1);
+    return wheels_[level - 1][timer->slot_];
+}
+
+void TimerWheel::link(const Timer::ptr &timer) {
+    std::list<Timer::ptr> &to = locate(timer.get());
+    timer->pos_ = to.insert(to.end(), timer);
+    ++count_;
+    if (timer->next_ < due_.load(std::memory_order_relaxed)) {
+        due_.store(timer->next_, std::memory_order_relaxed);
+    }
+}
+
+void TimerWheel::relink(Timer *timer) {
+    int level = timer->level_;
+    uint32_t slot = timer->slot_;
+    std::list<Timer::ptr> &from = bucket(level, slot);
+    std::list<Timer::ptr> &to = locate(timer);
+    // splice不分配内存, pos_仍然有效
+    to.splice(to.end(), from, timer->pos_);
+    if (level == 0 && from.empty()) {
+        rootBitmap_[slot / 64] &= ~(1ull << (slot % 64));
+    }
+    if (timer->next_ < due_.load(std::memory_order_relaxed)) {
+        due_.store(timer->next_, std::memory_order_relaxed);
+    }
+}
+
+void TimerWheel::unlink(Timer *timer) {
+    std::list<Timer::ptr> &from = bucket(timer->level_, timer->slot_);
+    if (timer->level_ == 0 && from.size() == 1) {
+        rootBitmap_[timer->slot_ / 64] &= ~(1ull << (timer->slot_ % 64));
+    }
+    timer->level_ = -1;
+    --count_;
+    from.erase(timer->pos_);
+}
+
+void TimerWheel::cascade() {
+    // 下一层转过一个槽, 把该槽的定时器重新放入下层, 整圈时继续处理更上一层
+    for (int level = 1; level <= WHEEL_LEVELS; ++level) {
+        uint32_t slot = (current_ >> (ROOT_BITS + (level - 1) * WHEEL_BITS)) & (WHEEL_SIZE - 1);
+        std::list<Timer::ptr> cascade;
+        cascade.swap(wheels_[level - 1][slot]);
+        while (!cascade.empty()) {
+            Timer *timer = cascade.front().get();
+            std::list<Timer::ptr> &to = locate(timer);
+            to.splice(to.end(), cascade, cascade.begin());
+        }
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+void TimerWheel::expireSlot(uint64_t now, std::list<Timer::ptr> &expired) {
+    uint32_t index = current_ & (ROOT_SIZE - 1);
+    std::list<Timer::ptr> &slot = root_[index];
+    for (auto it = slot.begin(); it != slot.end();) {
+        auto next = std::next(it);
+        if ((*it)->next_ <= now) {
+            (*it)->level_ = -1;
+            --count_;
+            expired.splice(expired.end(), slot, it);
+        }
+        it = next;
+    }
+    if (slot.empty()) {
+        rootBitmap_[index / 64] &= ~(1ull << (index % 64));
     }
-    return lhs.get() < rhs.get();
 }
 
-TimerManager::TimerManager() {
+uint64_t TimerWheel::nextExpire() const {
+    uint64_t next = ~0ull;
+    uint32_t start = current_ & (ROOT_SIZE - 1);
+    for (uint32_t offset = 0; offset < ROOT_SIZE;) {
+        uint32_t index = (start + offset) & (ROOT_SIZE - 1);
+        uint64_t bits = rootBitmap_[index / 64] >> (index % 64);
+        if (bits) {
+            // 槽内的定时器按微秒到期, 取最早的一个
+            for (auto &i : root_[(index + __builtin_ctzll(bits)) & (ROOT_SIZE - 1)]) {
+                next = std::min(next, i->next_);
+            }
+            break;
+        }
+        offset += 64 - index % 64;
+    }
+    // 上层的定时器在整圈时才下放, 可能早于第0层中最早的定时器
+    uint64_t boundary = (current_ + ROOT_SIZE) & ~(uint64_t)(ROOT_SIZE - 1);
+    for (; boundary * 1000 < next; boundary += ROOT_SIZE) {
+        uint32_t slot = (boundary >> ROOT_BITS) & (WHEEL_SIZE - 1);
+        // 第1层转满一圈时更上层也会下放
+        if (slot == 0 || !wheels_[0][slot].empty()) {
+            return boundary * 1000;
+        }
+    }
+    return next;
+}
 
+bool TimerWheel::rootEmpty() const {
+    for (uint64_t bits : rootBitmap_) {
+        if (bits) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool TimerWheel::updateNearest(uint64_t next) {
+    uint64_t nearest = nearest_;
+    while (next < nearest) {
+        if (nearest_.compare_exchange_weak(nearest, next)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TimerManager::TimerManager(size_t shards) {
+    for (size_t i = 0; i <= shards; ++i) {
+        wheels_.emplace_back(new TimerWheel);
+    }
 }
 TimerManager::~TimerManager() {
 
 }
 Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> callaback, bool recurring) {
-    Timer::ptr timer(new Timer(ms, callaback, recurring, this));
-    RWMutexType::WriteLock lock(mutex_);
-    addTimer(timer, lock);
+    return addTimerUS(ms * 1000, callaback, recurring);
+}
+Timer::ptr TimerManager::addTimerUS(uint64_t us, std::function<void()> callaback, bool recurring) {
+    Timer::ptr timer(new Timer(us, callaback, recurring, this));
+    addTimer(timer);
     return timer;
 }
-void TimerManager::addTimer(Timer::ptr timer, RWMutexType::WriteLock &lock) {
-    auto it = timers_.insert(timer).first;
-    bool at_front =  (it == timers_.begin());
+void TimerManager::addTimer(const Timer::ptr &timer) {
+    TimerWheel *wheel = currentWheel();
+    TimerWheel::MutexType::Lock lock(wheel->mutex());
+    timer->wheel_ = wheel;
+    wheel->link(timer);
+    bool at_front = wheel == wheels_.back().get() && wheel->updateNearest(timer->next_);
     lock.unlock();
     if (at_front) {
         onTimerInsertedAtFront();
-    }    
+    }
 }
 static void onTimer(std::weak_ptr<void> weak_cond, std::function<void()> callback) {
     std::shared_ptr<void> tmp = weak_cond.lock();
@@ -97,48 +323,148 @@ static void onTimer(std::weak_ptr<void> weak_cond, std::function<void()> callbac
     }
 }
 Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> callback, std::weak_ptr<void> weak_cond, bool recurring) {
-    return addTimer(ms, std::bind(&onTimer, weak_cond, callback), recurring);
+    return addTimerUS(ms * 1000, std::bind(&onTimer, weak_cond, callback), recurring);
+}
+Timer::ptr TimerManager::addConditionTimerUS(uint64_t us, std::function<void()> callback, std::weak_ptr<void> weak_cond, bool recurring) {
+    return addTimerUS(us, std::bind(&onTimer, weak_cond, callback), recurring);
+}
+
+TimerWheel* TimerManager::currentWheel() {
+    int shard = getTimerShard();
+    if (shard >= 0 && shard + 1 < (int)wheels_.size()) {
+        return wheels_[shard].get();
+    }
+    return wheels_.back().get();
 }
 
 uint64_t TimerManager::getNextTimerTime() {
-    RWMutexType::ReadLock lock(mutex_);
-    if (timers_.empty()) {
+    uint64_t next = getNextTimerTimeUS();
+    if (next == ~0ull) {
+        return ~0ull;
+    }
+    return (next + 999) / 1000;
+}
+
+uint64_t TimerManager::getNextTimerTimeUS() {
+    TimerWheel *own = currentWheel();
+    TimerWheel *shared = wheels_.back().get();
+    uint64_t next = ~0ull;
+    for (TimerWheel *wheel : {own, shared}) {
+        if (wheel->size() == 0) {
+            wheel->setNearest(~0ull);
+            continue;
+        }
+        TimerWheel::MutexType::Lock lock(wheel->mutex());
+        uint64_t expire = wheel->nextExpire();
+        wheel->setNearest(expire);
+        next = std::min(next, expire);
+        if (own == shared) {
+            break;
+        }
+    }
+    if (next == ~0ull) {
         return ~0ull;
     }
-    const Timer::ptr &tmp = *timers_.begin();
-    uint64_t curr = GetCurrentMS();
-    if (curr >= tmp->next_) {
+    uint64_t curr = GetCachedUS();
+    if (curr >= next) {
         return 0;
     } else {
-        return tmp->next_ - curr;
+        return next - curr;
     }
 }
 
 void TimerManager::listOverTimeCallback(std::vector<std::function<void()>> &cb) {
-    uint64_t curr = GetCurrentMS();
-    std::vector<Timer::ptr> expired;
-    {
-        RWMutexType::ReadLock lock(mutex_);
-        if (timers_.empty()) {
-            return;
-        }
+    uint64_t curr = GetCachedUS();
+    TimerWheel *own = currentWheel();
+    TimerWheel *shared = wheels_.back().get();
+    listExpired(own, curr, cb);
+    if (own != shared) {
+        listExpired(shared, curr, cb);
     }
+}
 
-    RWMutexType::WriteLock lock(mutex_);
-    Timer::ptr now_timer(new Timer(curr));
-    auto it = timers_.upper_bound(now_timer);
-    expired.insert(expired.begin(), timers_.begin(), it);
-    timers_.erase(timers_.begin(), it);
-    cb.reserve(expired.size());
+void TimerManager::listExpired(TimerWheel *wheel, uint64_t now, std::vector<std::function<void()>> &cb) {
+    if (wheel->size() == 0) {
+        return;
+    }
+    TimerWheel::MutexType::Lock lock(wheel->mutex());
+    if (!wheel->isDue(now)) {
+        return;
+    }
+    std::list<Timer::ptr> expired;
+    wheel->advance(now, expired);
+    cb.reserve(cb.size() + expired.size());
     for (auto &i : expired) {
-        cb.push_back(i->callback_);
         if (i->recurring_) {
-            i->next_ = curr + i->ms_;
-            timers_.insert(i);
+            cb.push_back(i->callback_);
+            i->next_ = now + i->us_;
+            wheel->link(i);
         } else {
+            cb.push_back(std::move(i->callback_));
             i->callback_ = nullptr;
         }
     }
 }
 
-}
\ No newline at end of file
+bool TimerManager::hasExpiredTimer() {
+    TimerWheel *wheel = currentWheel();
+    // 没有定时器时不读取时间
+    return wheel->size() > 0 && wheel->isDue(GetCachedUS());
+}
+
+bool TimerManager::hasTimer() {
+    for (auto &wheel : wheels_) {
+        if (wheel->size() > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+IdleTimer::IdleTimer(uint64_t timeout, std::function<void()> callback)
+    :timeout_(timeout), lastActive_(GetCachedMS()), callback_(std::move(callback)) {
+}
+
+IdleTimer::ptr IdleTimer::Create(TimerManager *manager, uint64_t timeout, std::function<void()> callback) {
+    IdleTimer::ptr idle(new IdleTimer(timeout, std::move(callback)));
+    std::weak_ptr<IdleTimer> weak_idle = idle;
+    // 持锁添加并赋值, 超时很短时onTimer等到赋值完成才读取timer_
+    IdleTimer::MutexType::Lock lock(idle->mutex_);
+    idle->timer_ = manager->addTimer(timeout, [weak_idle]() {
+        IdleTimer::ptr idle = weak_idle.lock();
+        if (idle) {
+            idle->onTimer();
+        }
+    }, true);
+    return idle;
+}
+
+IdleTimer::~IdleTimer() {
+    if (timer_) {
+        timer_->cancel();
+    }
+}
+
+void IdleTimer::onTimer() {
+    Timer::ptr timer;
+    {
+        MutexType::Lock lock(mutex_);
+        timer = timer_;
+    }
+    if (!timer) {
+        return;
+    }
+    uint64_t deadline = lastActive_.load(std::memory_order_relaxed) + timeout_;
+    uint64_t now = GetCachedMS();
+    if (deadline > now) {
+        // 期间有活动, 定时器提前到期, 按剩余时间重新检查
+        timer->reset(deadline - now, true);
+        return;
+    }
+    // cancel只会成功一次, 保证回调只执行一次
+    if (timer->cancel()) {
+        callback_();
+    }
+}
+
+}
@@ -0,0 +1,157 @@
+#include "uring.h"
+#include "log.h"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+namespace RPC {
+
+static Logger::ptr logger = RPC_LOG_ROOT();
+
+static int IoUringSetup(unsigned entries, io_uring_params *params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int IoUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int IoUringRegister(int fd, unsigned opcode, const void *arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+IoUring::IoUring()
+    :fd_(-1), eventfd_(-1), sqRing_(MAP_FAILED), sqRingSize_(0), cqRing_(MAP_FAILED), cqRingSize_(0),
+    sqes_((io_uring_sqe *)MAP_FAILED), sqesSize_(0), pending_(0) {
+}
+
+IoUring::~IoUring() {
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+        munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+        munmap(sqRing_, sqRingSize_);
+    }
+    if (eventfd_ >= 0) {
+        close(eventfd_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool IoUring::init(unsigned entries) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd_ = IoUringSetup(entries, &params);
+    if (fd_ < 0) {
+        RPC_LOG_WARN(logger) << "io_uring_setup fail, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && cqRingSize_ > sqRingSize_) {
+        sqRingSize_ = cqRingSize_;
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        RPC_LOG_ERROR(logger) << "io_uring mmap sq ring fail, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    if (single_mmap) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd_, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            RPC_LOG_ERROR(logger) << "io_uring mmap cq ring fail, errno=" << errno << " errstr=" << strerror(errno);
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = (io_uring_sqe *)mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                 fd_, IORING_OFF_SQES);
+    if (sqes_ == MAP_FAILED) {
+        RPC_LOG_ERROR(logger) << "io_uring mmap sqes fail, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    char *sq = (char *)sqRing_;
+    sqHead_ = (unsigned *)(sq + params.sq_off.head);
+    sqTail_ = (unsigned *)(sq + params.sq_off.tail);
+    sqFlags_ = (unsigned *)(sq + params.sq_off.flags);
+    sqArray_ = (unsigned *)(sq + params.sq_off.array);
+    sqMask_ = *(unsigned *)(sq + params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    char *cq = (char *)cqRing_;
+    cqHead_ = (unsigned *)(cq + params.cq_off.head);
+    cqTail_ = (unsigned *)(cq + params.cq_off.tail);
+    cqMask_ = *(unsigned *)(cq + params.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    eventfd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventfd_ < 0) {
+        RPC_LOG_ERROR(logger) << "eventfd fail, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    if (IoUringRegister(fd_, IORING_REGISTER_EVENTFD, &eventfd_, 1) != 0) {
+        RPC_LOG_WARN(logger) << "io_uring register eventfd fail, errno=" << errno << " errstr=" << strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+unsigned IoUring::sqSpace() const {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    return sqEntries_ - (*sqTail_ - head);
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    if (sqSpace() == 0) {
+        return nullptr;
+    }
+    unsigned tail = *sqTail_;
+    unsigned index = tail & sqMask_;
+    io_uring_sqe *sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    // 没有使用SQPOLL, 内核只在io_uring_enter时读取队列, 可以先移动队尾再填充
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    ++pending_;
+    return sqe;
+}
+
+int IoUring::submit() {
+    if (pending_ == 0) {
+        return 0;
+    }
+    int rt = IoUringEnter(fd_, pending_, 0, 0);
+    while (rt < 0 && errno == EINTR) {
+        rt = IoUringEnter(fd_, pending_, 0, 0);
+    }
+    if (rt < 0) {
+        // EAGAIN/EBUSY: 内核资源不足或完成队列积压, 留到下一次提交
+        if (errno != EAGAIN && errno != EBUSY) {
+            RPC_LOG_ERROR(logger) << "io_uring_enter fail, errno=" << errno << " errstr=" << strerror(errno);
+        }
+        return -1;
+    }
+    pending_ -= rt;
+    return rt;
+}
+
+bool IoUring::flushOverflow() {
+    if (!(__atomic_load_n(sqFlags_, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)) {
+        return false;
+    }
+    IoUringEnter(fd_, 0, 0, IORING_ENTER_GETEVENTS);
+    return *cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+}
+
+}
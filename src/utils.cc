@@ -1,11 +1,24 @@
 #include "utils.h"
 #include "fiber.h"
+#include "macro.h"
 #include <unistd.h>
 #include <syscall.h>
 #include <sys/time.h>
+#include <time.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <fstream>
+#include <string>
+#include <algorithm>
 namespace RPC {
 pid_t GetThreadId() {
-    return syscall(SYS_gettid);
+    // 线程id不会改变, 缓存起来避免每次都进行系统调用
+    static thread_local pid_t t_thread_id = 0;
+    if (RPC_UNLIKELY(t_thread_id == 0)) {
+        t_thread_id = syscall(SYS_gettid);
+    }
+    return t_thread_id;
 }
 
 
@@ -34,5 +47,164 @@ uint64_t GetCurrentUS() {
     return tm.tv_sec * 1000ul * 1000ul + tm.tv_usec;
 }
 
+#ifdef RPC_CLOCK_COARSE
+static const clockid_t s_cached_monotonic_clock = CLOCK_MONOTONIC_COARSE;
+static const clockid_t s_cached_realtime_clock = CLOCK_REALTIME_COARSE;
+#else
+static const clockid_t s_cached_monotonic_clock = CLOCK_MONOTONIC;
+static const clockid_t s_cached_realtime_clock = CLOCK_REALTIME;
+#endif
+
+static uint64_t ReadClockMS(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000ul + ts.tv_nsec / 1000000;
+}
+
+static uint64_t ReadClockUS(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000ul * 1000ul + ts.tv_nsec / 1000;
+}
+
+uint64_t GetMonotonicMS() {
+    return ReadClockMS(CLOCK_MONOTONIC);
+}
+
+uint64_t GetMonotonicUS() {
+    return ReadClockUS(CLOCK_MONOTONIC);
 }
 
+/**
+ * @brief 线程缓存的时间, valid为false时表示该线程从未刷新过, stale为true时下次读取前刷新
+ */
+struct CachedClock {
+    bool valid = false;
+    bool stale = false;
+    uint64_t us = 0;
+    uint64_t sec = 0;
+};
+static thread_local CachedClock t_cached_clock;
+
+uint64_t GetCachedMS() {
+    return GetCachedUS() / 1000;
+}
+
+uint64_t GetCachedUS() {
+    if (RPC_UNLIKELY(!t_cached_clock.valid)) {
+        return ReadClockUS(s_cached_monotonic_clock);
+    }
+    if (t_cached_clock.stale) {
+        UpdateCachedClock();
+    }
+    return t_cached_clock.us;
+}
+
+uint64_t GetCachedTime() {
+    if (RPC_UNLIKELY(!t_cached_clock.valid)) {
+        return ReadClockMS(s_cached_realtime_clock) / 1000;
+    }
+    if (t_cached_clock.stale) {
+        UpdateCachedClock();
+    }
+    return t_cached_clock.sec;
+}
+
+void UpdateCachedClock() {
+    t_cached_clock.us = ReadClockUS(s_cached_monotonic_clock);
+    t_cached_clock.sec = ReadClockMS(s_cached_realtime_clock) / 1000;
+    t_cached_clock.valid = true;
+    t_cached_clock.stale = false;
+}
+
+void InvalidateCachedClock() {
+    t_cached_clock.stale = true;
+}
+
+/**
+ * @brief 解析/sys中的cpulist格式, 如 "0-3,8,10-11"
+ */
+static std::vector<int> ParseCpuList(const std::string &list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string item = list.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty()) {
+            continue;
+        }
+        size_t dash = item.find('-');
+        int first = atoi(item.c_str());
+        int last = dash == std::string::npos ? first : atoi(item.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> GetNumaNodeCpus(std::vector<int> *ids) {
+    static const std::string s_node_path = "/sys/devices/system/node";
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    DIR *dir = opendir(s_node_path.c_str());
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4
+                || name.find_first_not_of("0123456789", 4) != std::string::npos) {
+                continue;
+            }
+            std::ifstream ifs(s_node_path + "/" + name + "/cpulist");
+            std::string list;
+            if (ifs && std::getline(ifs, list)) {
+                std::vector<int> cpus = ParseCpuList(list);
+                if (!cpus.empty()) {
+                    nodes.emplace_back(atoi(name.c_str() + 4), std::move(cpus));
+                }
+            }
+        }
+        closedir(dir);
+    }
+    std::vector<std::vector<int>> result;
+    if (ids) {
+        ids->clear();
+    }
+    if (nodes.empty()) {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        result.resize(1);
+        if (ids) {
+            ids->push_back(0);
+        }
+        for (long i = 0; i < count; ++i) {
+            result[0].push_back(i);
+        }
+        return result;
+    }
+    std::sort(nodes.begin(), nodes.end());
+    for (auto &node : nodes) {
+        if (ids) {
+            ids->push_back(node.first);
+        }
+        result.push_back(std::move(node.second));
+    }
+    return result;
+}
+
+int GetCurrentNumaNode() {
+    static std::vector<int> s_ids;
+    static const std::vector<std::vector<int>> s_nodes = GetNumaNodeCpus(&s_ids);
+    int cpu = sched_getcpu();
+    for (size_t i = 0; i < s_nodes.size(); ++i) {
+        if (std::find(s_nodes[i].begin(), s_nodes[i].end(), cpu) != s_nodes[i].end()) {
+            return s_ids[i];
+        }
+    }
+    return 0;
+}
+
+}
@@ -0,0 +1,25 @@
+/**
+ * @brief 线程绑定基准: 同一个IOManager里运行回显服务器和客户端, 比较不绑定、每个线程绑定一个CPU、
+ *  按NUMA节点分组三种设置下请求-响应的吞吐. NUMA分组时TCPServer把连接交给接收它的节点上的线程
+ *
+ *  ./bench_affinity [线程数, 默认CPU数] [连接数, 默认64] [每种设置的秒数, 默认3] [unpinned|pinned|numa|all]
+ */
+#include "bench_echo_common.h"
+#include <vector>
+
+int main(int argc, char **argv) {
+    return bench::RunEchoBench(argc, argv, {"unpinned", "pinned", "numa"},
+        [](const std::string &mode, size_t threads) {
+            RPC::IOManager *iom = new RPC::IOManager(threads, "bench");
+            if (mode == "pinned") {
+                std::vector<int> cpus;
+                for (long i = 0; i < sysconf(_SC_NPROCESSORS_ONLN); ++i) {
+                    cpus.push_back(i);
+                }
+                iom->setCpuAffinity(cpus);
+            } else if (mode == "numa") {
+                iom->setNumaAware(true);
+            }
+            return iom;
+        });
+}
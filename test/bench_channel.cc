@@ -0,0 +1,100 @@
+/**
+ * @brief channel基准: 比较加锁的Channel和无锁环形队列的SPSCChannel/MPMCChannel
+ *  ping-pong: 两个协程通过两个容量为1的channel来回传递, 测量每秒往返次数
+ *  fan-in: 8个生产者协程写同一个channel, 一个消费者读取, 分别测量容量2和1024时每秒的消息数
+ *  计时在协程中完成, 不包含IOManager析构的时间
+ *
+ *  ./bench_channel [工作线程数, 默认1] [ping-pong往返次数, 默认100000] [fan-in每个生产者的消息数, 默认50000]
+ */
+#include "io_manager.h"
+#include "channel.h"
+#include "ring_channel.h"
+#include "log.h"
+#include "utils.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <atomic>
+#include <iostream>
+
+static const int s_producers = 8;
+
+template<class C>
+static void pingpong(const char *name, size_t threads, long count) {
+    RPC::IOManager *iom = new RPC::IOManager(threads, "bench");
+    C ping(1), pong(1);
+    std::atomic<bool> done{false};
+    uint64_t us = 0;
+    long sum = 0;
+    iom->Submit([&]() {
+        uint64_t start = RPC::GetMonotonicUS();
+        for (long i = 0; i < count; ++i) {
+            ping << (int)i;
+            int x;
+            pong >> x;
+            sum += x;
+        }
+        us = RPC::GetMonotonicUS() - start;
+        done = true;
+    });
+    iom->Submit([&]() {
+        for (long i = 0; i < count; ++i) {
+            int x;
+            ping >> x;
+            pong << x;
+        }
+    });
+    while (!done) {
+        usleep(10 * 1000);
+    }
+    delete iom;
+    std::cout << name << " ping-pong: " << count * 1000.0 / us << " k round trips/s"
+              << (sum == count * (count - 1) / 2 ? "" : " (sum mismatch)") << std::endl;
+}
+
+template<class C>
+static void fanin(const char *name, size_t threads, long count, size_t capacity) {
+    RPC::IOManager *iom = new RPC::IOManager(threads, "bench");
+    C channel(capacity);
+    std::atomic<bool> done{false};
+    uint64_t start = RPC::GetMonotonicUS();
+    uint64_t us = 0;
+    long sum = 0;
+    for (int p = 0; p < s_producers; ++p) {
+        iom->Submit([&]() {
+            for (long i = 0; i < count; ++i) {
+                channel << 1;
+            }
+        });
+    }
+    iom->Submit([&]() {
+        for (long i = 0; i < s_producers * count; ++i) {
+            int x;
+            channel >> x;
+            sum += x;
+        }
+        us = RPC::GetMonotonicUS() - start;
+        done = true;
+    });
+    while (!done) {
+        usleep(10 * 1000);
+    }
+    delete iom;
+    std::cout << name << " fan-in cap " << capacity << ": " << s_producers * count * 1000.0 / us << " k msg/s"
+              << (sum == s_producers * count ? "" : " (sum mismatch)") << std::endl;
+}
+
+int main(int argc, char **argv) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    size_t threads = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+    long rounds = argc > 2 ? strtol(argv[2], nullptr, 10) : 100000;
+    long messages = argc > 3 ? strtol(argv[3], nullptr, 10) : 50000;
+    pingpong<RPC::Channel<int>>("Channel    ", threads, rounds);
+    pingpong<RPC::SPSCChannel<int>>("SPSCChannel", threads, rounds);
+    pingpong<RPC::MPMCChannel<int>>("MPMCChannel", threads, rounds);
+    // 多个生产者不能使用SPSCChannel
+    for (size_t capacity : {2, 1024}) {
+        fanin<RPC::Channel<int>>("Channel    ", threads, messages, capacity);
+        fanin<RPC::MPMCChannel<int>>("MPMCChannel", threads, messages, capacity);
+    }
+    return 0;
+}
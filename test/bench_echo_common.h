@@ -0,0 +1,138 @@
+#ifndef __RPC_BENCH_ECHO_COMMON_H__
+#define __RPC_BENCH_ECHO_COMMON_H__
+/**
+ * @brief 回显服务器基准的公共部分: 同一个IOManager里运行回显服务器和客户端,
+ *  每个连接在限定时间内反复发送固定长度的消息并读回, 统计请求-响应的吞吐.
+ *  各基准只提供每种模式的IOManager和输出行末尾的附加信息
+ *
+ *  命令行: [线程数, 默认CPU数] [连接数, 默认64] [每种模式的秒数, 默认3] [模式名|all]
+ */
+#include "io_manager.h"
+#include "tcp_server.h"
+#include "address.h"
+#include "socket.h"
+#include "log.h"
+#include "utils.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace bench {
+
+static const size_t s_message_size = 64;
+
+class EchoServer : public RPC::TCPServer {
+public:
+    EchoServer(RPC::IOManager *worker):RPC::TCPServer(worker, worker) {}
+    RPC::Address::ptr getAddress() { return socks_.at(0)->getLocalAddress(); }
+protected:
+    void handleClient(RPC::Socket::ptr client) override {
+        char buffer[s_message_size];
+        while (true) {
+            int n = client->recv(buffer, sizeof(buffer));
+            if (n <= 0 || client->send(buffer, n) != n) {
+                break;
+            }
+        }
+        client->close();
+    }
+};
+
+/**
+ * @brief 读满length字节
+ */
+inline bool RecvAll(RPC::Socket::ptr sock, char *buffer, size_t length) {
+    size_t got = 0;
+    while (got < length) {
+        int n = sock->recv(buffer + got, length - got);
+        if (n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+/**
+ * @brief 在iom中运行回显服务器和connections个客户端seconds秒
+ * @param report 客户端全部结束、服务器停止之前以完成的请求数调用
+ */
+inline void RunEcho(RPC::IOManager *iom, size_t connections, uint64_t seconds,
+                    const std::function<void(uint64_t requests)> &report) {
+    std::shared_ptr<EchoServer> server(new EchoServer(iom));
+    std::atomic<uint64_t> requests{0};
+    std::atomic<size_t> done{0};
+    // socket需要在开启hook的工作线程中创建
+    iom->Submit([&]() {
+        if (!server->bind(RPC::Address::LookupAny("127.0.0.1"))) {
+            std::cout << "bind fail" << std::endl;
+            done = connections;
+            return;
+        }
+        server->start();
+        RPC::Address::ptr address = server->getAddress();
+        uint64_t deadline = RPC::GetMonotonicUS() + seconds * 1000 * 1000;
+        for (size_t i = 0; i < connections; ++i) {
+            iom->Submit([address, deadline, &requests, &done]() {
+                RPC::Socket::ptr sock = RPC::Socket::CreateTCP(address);
+                if (sock->connect(address)) {
+                    char buffer[s_message_size] = {0};
+                    uint64_t count = 0;
+                    while (RPC::GetMonotonicUS() < deadline) {
+                        if (sock->send(buffer, sizeof(buffer)) != (int)sizeof(buffer)
+                            || !RecvAll(sock, buffer, sizeof(buffer))) {
+                            break;
+                        }
+                        ++count;
+                    }
+                    requests += count;
+                    sock->close();
+                }
+                ++done;
+            });
+        }
+    });
+    while (done < connections) {
+        usleep(10 * 1000);
+    }
+    report(requests);
+    server->stop();
+}
+
+/**
+ * @brief 解析命令行, 依次运行选中的模式并输出吞吐
+ *
+ * @param modes 模式名, 命令行第四个参数选择其中一个, 默认全部
+ * @param make 按模式名和线程数创建IOManager
+ * @param extra 客户端全部结束、服务器停止之前返回输出行末尾的附加信息, 可以为空
+ */
+inline int RunEchoBench(int argc, char **argv, std::initializer_list<const char*> modes,
+        std::function<RPC::IOManager*(const std::string &mode, size_t threads)> make,
+        std::function<std::string(RPC::IOManager *iom, uint64_t requests)> extra = nullptr) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    size_t threads = argc > 1 ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+    size_t connections = argc > 2 ? atoi(argv[2]) : 64;
+    uint64_t seconds = argc > 3 ? atoi(argv[3]) : 3;
+    std::string selected = argc > 4 ? argv[4] : "all";
+    for (const char *mode : modes) {
+        if (selected != "all" && selected != mode) {
+            continue;
+        }
+        RPC::IOManager *iom = make(mode, threads);
+        RunEcho(iom, connections, seconds, [&](uint64_t requests) {
+            std::cout << mode << ": " << threads << " threads " << connections << " connections "
+                      << requests / seconds << " req/s" << (extra ? extra(iom, requests) : "") << std::endl;
+        });
+        delete iom;
+    }
+    return 0;
+}
+
+}
+
+#endif
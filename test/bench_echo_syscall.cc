@@ -0,0 +1,38 @@
+/**
+ * @brief 常驻注册基准: 回显服务器上每个请求的epoll_ctl次数, 比较每次等待都修改注册和常驻边沿触发注册两种模式
+ *  可执行文件中定义的epoll_ctl覆盖libc的版本, 计数后转发给原函数.
+ *  io_uring可用时数据未就绪的读写交给io_uring, 不经过epoll, 比较epoll路径时用-DIOMANAGER_USE_IO_URING=OFF构建
+ *
+ *  ./bench_echo_syscall [线程数, 默认CPU数] [连接数, 默认64] [每种模式的秒数, 默认3] [oneshot|persistent|all]
+ */
+#include "bench_echo_common.h"
+#include <dlfcn.h>
+#include <sys/epoll.h>
+#include <sstream>
+
+static std::atomic<uint64_t> s_epoll_ctl{0};
+// 每种模式开始时的epoll_ctl次数
+static uint64_t s_ctl_start = 0;
+
+extern "C" int epoll_ctl(int epfd, int op, int fd, struct epoll_event *event) {
+    typedef int (*epoll_ctl_fun)(int, int, int, struct epoll_event*);
+    static epoll_ctl_fun s_epoll_ctl_f = (epoll_ctl_fun)dlsym(RTLD_NEXT, "epoll_ctl");
+    ++s_epoll_ctl;
+    return s_epoll_ctl_f(epfd, op, fd, event);
+}
+
+int main(int argc, char **argv) {
+    return bench::RunEchoBench(argc, argv, {"oneshot", "persistent"},
+        [](const std::string &mode, size_t threads) {
+            RPC::IOManager *iom = new RPC::IOManager(threads, "bench", false, mode == "persistent");
+            s_ctl_start = s_epoll_ctl;
+            return iom;
+        },
+        [](RPC::IOManager *iom, uint64_t requests) {
+            uint64_t ctl = s_epoll_ctl - s_ctl_start;
+            std::ostringstream os;
+            os << ", epoll_ctl " << ctl << " (" << (double)ctl / (requests ? requests : 1)
+               << " per request, io_uring " << (iom->hasIoUring() ? "on" : "off") << ")";
+            return os.str();
+        });
+}
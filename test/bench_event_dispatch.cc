@@ -0,0 +1,98 @@
+/**
+ * @brief 事件分发基准: N个socketpair的读端各由一个协程阻塞接收, 写端轮流写入带序号的数据,
+ *  检查每个协程收到的数据都属于自己(分发到错误的句柄或句柄复用前的旧事件会导致数据错乱),
+ *  并统计每秒分发的事件数. 每轮结束后关闭所有句柄, 下一轮复用相同的句柄号
+ *
+ *  ./bench_event_dispatch [句柄对数, 默认10000(受RLIMIT_NOFILE限制)] [轮数, 默认2] [线程数, 默认2] [p:独立epoll e:常驻注册]
+ */
+#include "io_manager.h"
+#include "fd_manager.h"
+#include "hook.h"
+#include "log.h"
+#include "utils.h"
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+
+/* 每个句柄接收的消息数 */
+static const int s_messages = 30;
+
+int main(int argc, char **argv) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    size_t pairs = argc > 1 ? strtoull(argv[1], nullptr, 10) : 10000;
+    int cycles = argc > 2 ? atoi(argv[2]) : 2;
+    size_t threads = argc > 3 ? atoi(argv[3]) : 2;
+    const char *flags = argc > 4 ? argv[4] : "";
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (pairs * 2 + 64 > limit.rlim_cur) {
+        pairs = (limit.rlim_cur - 64) / 2;
+        std::cout << "RLIMIT_NOFILE=" << limit.rlim_cur << ", use " << pairs << " pairs" << std::endl;
+    }
+    RPC::IOManager *iom = new RPC::IOManager(threads, "bench", strchr(flags, 'p'), strchr(flags, 'e'));
+    std::vector<int> readers(pairs), writers(pairs);
+    std::atomic<uint64_t> bad{0};
+    std::atomic<size_t> done{0};
+    for (int cycle = 0; cycle < cycles; ++cycle) {
+        for (size_t i = 0; i < pairs; ++i) {
+            int sv[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+                std::cout << "socketpair fail errno=" << errno << std::endl;
+                return 1;
+            }
+            readers[i] = sv[0];
+            writers[i] = sv[1];
+            // socketpair没有被hook, 手动创建fd上下文, 读端按hook的socket处理
+            RPC::FdMgr::GetInstance()->getFdContext(sv[0], true);
+        }
+        done = 0;
+        uint64_t start = RPC::GetMonotonicUS();
+        for (size_t i = 0; i < pairs; ++i) {
+            iom->Submit([i, pairs, &readers, &bad, &done]() {
+                for (int r = 0; r < s_messages; ++r) {
+                    uint64_t value = 0;
+                    ssize_t n = recv(readers[i], &value, sizeof(value), MSG_WAITALL);
+                    if (n != sizeof(value) || value != r * pairs + i) {
+                        ++bad;
+                    }
+                }
+                ++done;
+            });
+        }
+        // 每轮写完后停一下, 让读协程重新挂起, 下一轮的数据经过事件分发唤醒
+        for (int r = 0; r < s_messages; ++r) {
+            for (size_t i = 0; i < pairs; ++i) {
+                uint64_t value = r * pairs + i;
+                send_f(writers[i], &value, sizeof(value), 0);
+            }
+            usleep(2000);
+        }
+        while (done < pairs) {
+            usleep(1000);
+        }
+        uint64_t used = RPC::GetMonotonicUS() - start;
+        std::cout << "cycle " << cycle << ": " << pairs << " fds " << pairs * s_messages << " events, bad "
+                  << bad << ", " << pairs * s_messages * 1.0 / used << " M events/s (including "
+                  << s_messages * 2 << " ms of writer pauses)" << std::endl;
+        // 在工作线程中关闭, 清除句柄上的注册, 下一轮复用相同的句柄号
+        done = 0;
+        iom->Submit([&]() {
+            for (size_t i = 0; i < pairs; ++i) {
+                close(readers[i]);
+                close_f(writers[i]);
+            }
+            done = 1;
+        });
+        while (done == 0) {
+            usleep(1000);
+        }
+    }
+    delete iom;
+    return bad ? 1 : 0;
+}
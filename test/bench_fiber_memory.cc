@@ -0,0 +1,92 @@
+/**
+ * @brief 空闲协程的内存基准: 创建N个模拟空闲连接的协程, 每个用掉几KB栈后挂起在channel上,
+ *  统计全部挂起后进程常驻内存(RSS)和虚拟内存的增量, 对比独立栈和共享栈模式
+ *  独立栈每个协程占用两个内存映射(栈和守护页), 数量受vm.max_map_count限制(默认65530)
+ *
+ *  ./bench_fiber_memory [协程数, 默认20000] [shared|independent|both, 默认both]
+ */
+#include "io_manager.h"
+#include "channel.h"
+#include "fiber.h"
+#include "log.h"
+#include "utils.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <iostream>
+#include <string>
+
+/**
+ * @brief 读取/proc/self/statm, 返回虚拟内存和常驻内存(字节)
+ */
+static void read_statm(uint64_t &vm, uint64_t &rss) {
+    vm = rss = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return;
+    }
+    unsigned long size = 0, resident = 0;
+    if (fscanf(file, "%lu %lu", &size, &resident) == 2) {
+        vm = (uint64_t)size * getpagesize();
+        rss = (uint64_t)resident * getpagesize();
+    }
+    fclose(file);
+}
+
+/**
+ * @brief 模拟连接处理函数的栈帧, 例如接收缓冲区
+ */
+static void __attribute__((noinline)) handle_client(RPC::Channel<int> quit, std::atomic<size_t> &waiting) {
+    char buffer[4096];
+    memset(buffer, 0, sizeof(buffer));
+    ++waiting;
+    int v = 0;
+    quit >> v;
+    // 防止缓冲区被优化掉
+    __asm__ __volatile__("" : : "r"(buffer) : "memory");
+}
+
+static void bench(size_t count, bool shared_stack) {
+    RPC::IOManager *iom = new RPC::IOManager(1, "bench");
+    RPC::Channel<int> quit(1);
+    std::atomic<size_t> waiting{0};
+    // 先让工作线程和共享栈初始化, 不计入协程的内存
+    iom->Submit([]() {}, -1, shared_stack);
+    usleep(100 * 1000);
+    uint64_t vm0, rss0;
+    read_statm(vm0, rss0);
+    for (size_t i = 0; i < count; ++i) {
+        iom->Submit([quit, &waiting]() {
+            handle_client(quit, waiting);
+        }, -1, shared_stack);
+    }
+    while (waiting < count) {
+        usleep(10 * 1000);
+    }
+    uint64_t vm1, rss1;
+    read_statm(vm1, rss1);
+    double rss = (double)(rss1 - rss0) / count;
+    double vm = (double)(vm1 - vm0) / count;
+    std::cout << (shared_stack ? "shared stack     " : "independent stack") << ": " << count << " fibers, "
+              << "RSS " << rss / 1024 << " KiB/fiber (" << rss * 100000 / (1 << 20) << " MiB per 100k), "
+              << "VM " << vm / 1024 << " KiB/fiber";
+    if (shared_stack) {
+        std::cout << ", saved stack " << RPC::Fiber::GetSharedStackSavedBytes() / count << " B/fiber";
+    }
+    std::cout << std::endl;
+    quit.close();
+    delete iom;
+}
+
+int main(int argc, char **argv) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    size_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 20000;
+    std::string mode = argc > 2 ? argv[2] : "both";
+    if (mode != "shared") {
+        bench(count, false);
+    }
+    if (mode != "independent") {
+        bench(count, true);
+    }
+    return 0;
+}
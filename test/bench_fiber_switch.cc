@@ -0,0 +1,76 @@
+/**
+ * @brief 协程切换基准: 测量Fiber::Resume/YieldToHold每秒的切换次数
+ *  同时给出直接调用swapcontext的结果作为对照, 它每次切换都有一次rt_sigprocmask系统调用.
+ *  对比两种实现: 默认构建使用汇编切换, -DFIBER_USE_UCONTEXT=ON构建使用ucontext
+ *
+ *  ./bench_fiber_switch [切换次数, 默认10000000]
+ */
+#include "fiber.h"
+#include "log.h"
+#include "utils.h"
+#include <ucontext.h>
+#include <iostream>
+#include <stdlib.h>
+
+static uint64_t s_rounds = 10000000;
+
+static ucontext_t s_main_ctx;
+static ucontext_t s_fiber_ctx;
+
+static void ucontext_func() {
+    while (true) {
+        swapcontext(&s_fiber_ctx, &s_main_ctx);
+    }
+}
+
+static double bench_ucontext() {
+    static char stack[128 * 1024];
+    getcontext(&s_fiber_ctx);
+    s_fiber_ctx.uc_stack.ss_sp = stack;
+    s_fiber_ctx.uc_stack.ss_size = sizeof(stack);
+    s_fiber_ctx.uc_link = nullptr;
+    makecontext(&s_fiber_ctx, ucontext_func, 0);
+    uint64_t start = RPC::GetMonotonicUS();
+    for (uint64_t i = 0; i < s_rounds; ++i) {
+        swapcontext(&s_main_ctx, &s_fiber_ctx);
+    }
+    return RPC::GetMonotonicUS() - start;
+}
+
+static double bench_fiber() {
+    RPC::Fiber::EnableFiber();
+    RPC::Fiber::ptr fiber(new RPC::Fiber([]() {
+        for (uint64_t i = 0; i < s_rounds; ++i) {
+            RPC::Fiber::YieldToHold();
+        }
+    }));
+    uint64_t start = RPC::GetMonotonicUS();
+    for (uint64_t i = 0; i < s_rounds; ++i) {
+        fiber->Resume();
+    }
+    uint64_t used = RPC::GetMonotonicUS() - start;
+    // 让协程执行结束
+    fiber->Resume();
+    return used;
+}
+
+static void report(const char *name, double us) {
+    // 每轮切入和切出各一次
+    std::cout << name << ": " << s_rounds << " rounds " << us / 1000 << " ms, "
+              << s_rounds * 2 / us << " M switches/s, "
+              << us * 1000 / (s_rounds * 2) << " ns/switch" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    if (argc > 1) {
+        s_rounds = strtoull(argv[1], nullptr, 10);
+    }
+#ifdef RPC_FIBER_UCONTEXT
+    report("Fiber(ucontext)", bench_fiber());
+#else
+    report("Fiber(asm)     ", bench_fiber());
+#endif
+    report("swapcontext    ", bench_ucontext());
+    return 0;
+}
@@ -0,0 +1,86 @@
+/**
+ * @brief hook开销基准: 数据已经就绪时, 比较hook后的recv/read和直接调用原始系统调用每次的耗时,
+ *  差值就是hook快路径(fd上下文查找、超时读取)的开销. 另外单独测量fd上下文的无锁查找
+ *
+ *  ./bench_hook_overhead [每项的调用次数, 默认1000000]
+ */
+#include "io_manager.h"
+#include "fd_manager.h"
+#include "epoch.h"
+#include "hook.h"
+#include "log.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+
+static void report(const char *name, uint64_t count, uint64_t us) {
+    std::cout << name << ": " << us * 1000.0 / count << " ns/call" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    RPC::IOManager *iom = new RPC::IOManager(1, "bench");
+    std::atomic<bool> done{false};
+    iom->Submit([&]() {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+            std::cout << "socketpair fail" << std::endl;
+            done = true;
+            return;
+        }
+        // socketpair没有被hook, 手动给读端创建fd上下文, 之后按hook的socket处理
+        RPC::FdMgr::GetInstance()->getFdContext(sv[0], true);
+        char c = 0;
+        // 每次先写一个字节, 接收时数据已经就绪, 不会挂起协程
+        uint64_t start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < count; ++i) {
+            send_f(sv[1], &c, 1, 0);
+            recv_f(sv[0], &c, 1, 0);
+        }
+        report("raw    send+recv", count, RPC::GetMonotonicUS() - start);
+        start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < count; ++i) {
+            send_f(sv[1], &c, 1, 0);
+            recv(sv[0], &c, 1, 0);
+        }
+        report("hooked send+recv", count, RPC::GetMonotonicUS() - start);
+
+        // 不是socket的fd, hook只做一次查找就调用原函数
+        int fd = open("/dev/zero", O_RDONLY);
+        start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < count; ++i) {
+            read_f(fd, &c, 1);
+        }
+        report("raw    read     ", count, RPC::GetMonotonicUS() - start);
+        start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < count; ++i) {
+            read(fd, &c, 1);
+        }
+        report("hooked read     ", count, RPC::GetMonotonicUS() - start);
+
+        uint64_t sockets = 0;
+        start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < count; ++i) {
+            RPC::Epoch::Guard guard;
+            RPC::FdContext *ctx = RPC::FdMgr::GetInstance()->lookup(sv[0]);
+            sockets += ctx && ctx->isSocket();
+        }
+        report("fd lookup       ", count, RPC::GetMonotonicUS() - start);
+        if (sockets != count) {
+            std::cout << "lookup mismatch " << sockets << std::endl;
+        }
+        close(fd);
+        close(sv[0]);
+        close(sv[1]);
+        done = true;
+    });
+    while (!done) {
+        usleep(10 * 1000);
+    }
+    delete iom;
+    return 0;
+}
@@ -0,0 +1,21 @@
+/**
+ * @brief epoll模式基准: 同一个IOManager里运行回显服务器和客户端, 比较所有线程共享一个epoll
+ *  和每个工作线程一个epoll两种模式下请求-响应的吞吐, 以及唤醒epoll_wait的次数
+ *
+ *  ./bench_reactor [线程数, 默认CPU数] [连接数, 默认64] [每种模式的秒数, 默认3] [shared|per-thread|all]
+ */
+#include "bench_echo_common.h"
+#include <sstream>
+
+int main(int argc, char **argv) {
+    return bench::RunEchoBench(argc, argv, {"shared", "per-thread"},
+        [](const std::string &mode, size_t threads) {
+            return new RPC::IOManager(threads, "bench", mode == "per-thread");
+        },
+        [](RPC::IOManager *iom, uint64_t requests) {
+            RPC::IOManager::NotifyStats stats = iom->getNotifyStats();
+            std::ostringstream os;
+            os << ", eventfd wakeups " << stats.issued << " (suppressed " << stats.suppressed << ")";
+            return os.str();
+        });
+}
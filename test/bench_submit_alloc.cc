@@ -0,0 +1,147 @@
+/**
+ * @brief 任务提交基准: 统计Submit到任务执行完成期间每个任务的堆分配次数和吞吐
+ *  通过替换全局operator new计数, 覆盖外部线程提交、工作线程内提交、
+ *  std::bind(成员函数, shared_ptr...)形式的任务, 以及先包装成std::function再提交的对照
+ *
+ *  ./bench_submit_alloc [每种情况的任务数, 默认1000000] [工作线程数, 默认1]
+ */
+#include "scheduler.h"
+#include "log.h"
+#include "utils.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <new>
+
+static std::atomic<uint64_t> s_allocs{0};
+
+void* operator new(size_t size) {
+    ++s_allocs;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+/**
+ * @brief 模拟TCPServer::handleClient: 成员函数绑定shared_ptr
+ */
+struct Handler {
+    void handle(std::shared_ptr<int> client) {
+        done->fetch_add(1, std::memory_order_relaxed);
+    }
+    std::atomic<uint64_t> *done;
+};
+
+static void wait_done(std::atomic<uint64_t> &done, uint64_t count) {
+    while (done.load() < count) {
+        usleep(100);
+    }
+}
+
+static void report(const char *name, uint64_t count, uint64_t allocs, uint64_t us) {
+    std::cout << name << ": " << (double)allocs / count << " allocs/task, "
+              << count * 1.0 / us << " M tasks/s" << std::endl;
+}
+
+/**
+ * @brief 外部线程提交lambda, 任务进入全局队列
+ */
+static void bench_external(RPC::Scheduler &sc, uint64_t count) {
+    std::atomic<uint64_t> done{0};
+    std::atomic<uint64_t> *pdone = &done;
+    uint64_t allocs = s_allocs;
+    uint64_t start = RPC::GetMonotonicUS();
+    for (uint64_t i = 0; i < count; ++i) {
+        sc.Submit([pdone, i]() {
+            pdone->fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+    wait_done(done, count);
+    report("external lambda  ", count, s_allocs - allocs, RPC::GetMonotonicUS() - start);
+}
+
+/**
+ * @brief 工作线程中提交lambda, 任务进入本线程的队列
+ */
+static void bench_internal(RPC::Scheduler &sc, uint64_t count, const char *name = "internal lambda  ") {
+    std::atomic<uint64_t> done{0};
+    std::atomic<uint64_t> *pdone = &done;
+    uint64_t allocs = s_allocs;
+    uint64_t start = RPC::GetMonotonicUS();
+    sc.Submit([&sc, pdone, count]() {
+        for (uint64_t i = 0; i < count; ++i) {
+            sc.Submit([pdone, i]() {
+                pdone->fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+    });
+    wait_done(done, count);
+    report(name, count, s_allocs - allocs, RPC::GetMonotonicUS() - start);
+}
+
+/**
+ * @brief std::bind成员函数和shared_ptr, 不计入创建shared_ptr本身的分配
+ */
+static void bench_bind(RPC::Scheduler &sc, uint64_t count) {
+    std::atomic<uint64_t> done{0};
+    Handler handler;
+    handler.done = &done;
+    std::shared_ptr<int> client = std::make_shared<int>(0);
+    uint64_t allocs = s_allocs;
+    uint64_t start = RPC::GetMonotonicUS();
+    sc.Submit([&sc, &handler, client, count]() {
+        for (uint64_t i = 0; i < count; ++i) {
+            sc.Submit(std::bind(&Handler::handle, &handler, client));
+        }
+    });
+    wait_done(done, count);
+    report("internal std::bind", count, s_allocs - allocs, RPC::GetMonotonicUS() - start);
+}
+
+/**
+ * @brief 对照: 先包装成std::function, 捕获超过std::function的内联大小时每次分配
+ */
+static void bench_function(RPC::Scheduler &sc, uint64_t count) {
+    std::atomic<uint64_t> done{0};
+    std::atomic<uint64_t> *pdone = &done;
+    uint64_t allocs = s_allocs;
+    uint64_t start = RPC::GetMonotonicUS();
+    sc.Submit([&sc, pdone, count]() {
+        for (uint64_t i = 0; i < count; ++i) {
+            std::function<void()> func = [pdone, i, count]() {
+                pdone->fetch_add(1, std::memory_order_relaxed);
+            };
+            sc.Submit(std::move(func));
+        }
+    });
+    wait_done(done, count);
+    report("std::function     ", count, s_allocs - allocs, RPC::GetMonotonicUS() - start);
+}
+
+int main(int argc, char **argv) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t threads = argc > 2 ? atoi(argv[2]) : 1;
+    RPC::Scheduler sc(threads, "bench");
+    sc.Start();
+    // 预热: 让队列和任务协程分配好
+    bench_internal(sc, count / 10 + 1, "warm up          ");
+    bench_external(sc, count);
+    bench_internal(sc, count);
+    bench_bind(sc, count);
+    bench_function(sc, count);
+    sc.Stop();
+    return 0;
+}
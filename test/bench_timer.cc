@@ -0,0 +1,65 @@
+/**
+ * @brief 定时器基准: 在一个工作线程上创建N个长时间不到期的定时器(模拟每个连接的心跳),
+ *  测量添加、随机reset(每个请求推迟心跳)、refresh和cancel每秒的次数
+ *
+ *  ./bench_timer [定时器数量, 默认1000000] [reset次数, 默认与定时器数量相同]
+ */
+#include "io_manager.h"
+#include "timer.h"
+#include "log.h"
+#include "utils.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+
+static void report(const char *name, uint64_t count, uint64_t us) {
+    std::cout << name << ": " << count << " ops " << us / 1000 << " ms, "
+              << count * 1.0 / us << " M ops/s" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    RPC_LOG_ROOT()->setLevel(RPC::LogLevel::INFO);
+    uint64_t count = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    uint64_t resets = argc > 2 ? strtoull(argv[2], nullptr, 10) : count;
+    RPC::IOManager *iom = new RPC::IOManager(1, "bench");
+    std::atomic<bool> done{false};
+    iom->Submit([&]() {
+        std::vector<RPC::Timer::ptr> timers;
+        timers.reserve(count);
+        // 心跳超时在60~120秒之间, 测试期间不会到期
+        uint64_t start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < count; ++i) {
+            timers.push_back(iom->addTimer(60 * 1000 + i % (60 * 1000), []() {}));
+        }
+        report("add    ", count, RPC::GetMonotonicUS() - start);
+
+        uint32_t seed = 2463534242u;
+        start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < resets; ++i) {
+            seed ^= seed << 13;
+            seed ^= seed >> 17;
+            seed ^= seed << 5;
+            timers[seed % count]->reset(60 * 1000 + seed % (60 * 1000), true);
+        }
+        report("reset  ", resets, RPC::GetMonotonicUS() - start);
+
+        start = RPC::GetMonotonicUS();
+        for (uint64_t i = 0; i < resets; ++i) {
+            timers[i % count]->refresh();
+        }
+        report("refresh", resets, RPC::GetMonotonicUS() - start);
+
+        start = RPC::GetMonotonicUS();
+        for (auto &timer : timers) {
+            timer->cancel();
+        }
+        report("cancel ", count, RPC::GetMonotonicUS() - start);
+        done = true;
+    });
+    while (!done) {
+        usleep(10 * 1000);
+    }
+    delete iom;
+    return 0;
+}
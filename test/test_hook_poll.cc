@@ -0,0 +1,331 @@
+/**
+ * @brief hook后的poll/select/epoll_wait和pread/pwrite
+ *  在socketpair上检查就绪和超时、同一个句柄重复出现、多个协程等待同一个句柄、
+ *  poll过的管道关闭后、socket不经过hook关闭后句柄号被socket复用, 以及普通文件读写经过阻塞线程池后的结果
+ */
+#include "io_manager.h"
+#include "fd_manager.h"
+#include "hook.h"
+#include "log.h"
+#include "macro.h"
+#include "utils.h"
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+static RPC::Logger::ptr logger = RPC_LOG_ROOT();
+
+/**
+ * @brief socketpair没有被hook, 手动给两端创建fd上下文
+ */
+static void make_pair(int sv[2]) {
+    RPC_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    RPC::FdMgr::GetInstance()->getFdContext(sv[0], true);
+    RPC::FdMgr::GetInstance()->getFdContext(sv[1], true);
+}
+
+static void close_pair(int sv[2]) {
+    close(sv[0]);
+    close(sv[1]);
+}
+
+/**
+ * @brief delay_ms毫秒后在另一个协程中向fd写入count个字节
+ */
+static void write_later(int fd, uint64_t delay_ms, size_t count = 1) {
+    RPC::IOManager::GetThis()->Submit([fd, delay_ms, count]() {
+        usleep(delay_ms * 1000);
+        std::string data(count, 'x');
+        RPC_ASSERT(write(fd, data.data(), count) == (ssize_t)count);
+    });
+}
+
+/**
+ * @brief 在协程中并发执行funcs, 全部返回后才返回
+ */
+static void run_all(const std::vector<std::function<void()>> &funcs) {
+    std::shared_ptr<std::atomic<size_t>> left(new std::atomic<size_t>(funcs.size()));
+    for (auto &func : funcs) {
+        RPC::IOManager::GetThis()->Submit([func, left]() {
+            func();
+            --*left;
+        });
+    }
+    while (*left) {
+        usleep(1000);
+    }
+}
+
+static void test_poll() {
+    int sv[2];
+    make_pair(sv);
+    // 超时
+    pollfd pfd;
+    pfd.fd = sv[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    uint64_t start = RPC::GetMonotonicMS();
+    RPC_ASSERT(poll(&pfd, 1, 50) == 0);
+    RPC_ASSERT(RPC::GetMonotonicMS() - start >= 45);
+    // 可写立即返回
+    pfd.events = POLLOUT;
+    RPC_ASSERT(poll(&pfd, 1, 1000) == 1 && (pfd.revents & POLLOUT));
+    // 对端写入后可读
+    pfd.events = POLLIN;
+    write_later(sv[1], 20);
+    start = RPC::GetMonotonicMS();
+    RPC_ASSERT(poll(&pfd, 1, 1000) == 1 && (pfd.revents & POLLIN));
+    RPC_ASSERT(RPC::GetMonotonicMS() - start < 500);
+    close_pair(sv);
+    RPC_LOG_INFO(logger) << "test_poll ok";
+}
+
+static void test_poll_duplicate() {
+    int sv[2];
+    make_pair(sv);
+    // 同一个句柄出现两次, 只注册一次, 两项都报告就绪
+    pollfd pfds[2];
+    for (int i = 0; i < 2; ++i) {
+        pfds[i].fd = sv[0];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+    write_later(sv[1], 20);
+    RPC_ASSERT(poll(pfds, 2, 1000) == 2);
+    RPC_ASSERT((pfds[0].revents & POLLIN) && (pfds[1].revents & POLLIN));
+    // 两项都超时
+    char c;
+    RPC_ASSERT(read(sv[0], &c, 1) == 1);
+    RPC_ASSERT(poll(pfds, 2, 30) == 0);
+    close_pair(sv);
+    RPC_LOG_INFO(logger) << "test_poll_duplicate ok";
+}
+
+static void test_poll_shared() {
+    int sv[2];
+    make_pair(sv);
+    // 两个协程poll同一个句柄, 后注册的得到ADD_BUSY, 靠定时检查发现就绪
+    std::atomic<int> ready{0};
+    auto waiter = [&sv, &ready]() {
+        pollfd pfd;
+        pfd.fd = sv[0];
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 1000) == 1) {
+            ++ready;
+        }
+    };
+    // poll和read同时等待同一个句柄: 写入两个字节, read取走一个后poll仍然能看到剩下的
+    auto reader = [&sv, &ready]() {
+        char c;
+        if (read(sv[0], &c, 1) == 1) {
+            ++ready;
+        }
+    };
+    write_later(sv[1], 20, 2);
+    uint64_t start = RPC::GetMonotonicMS();
+    run_all({waiter, waiter, reader});
+    RPC_ASSERT(ready == 3);
+    RPC_ASSERT(RPC::GetMonotonicMS() - start < 500);
+    close_pair(sv);
+    RPC_LOG_INFO(logger) << "test_poll_shared ok";
+}
+
+static void test_poll_pri() {
+    int sv[2];
+    make_pair(sv);
+    // 只关心POLLPRI时没有可以注册的事件, 仍然按超时返回而不是一直挂起
+    pollfd pfd;
+    pfd.fd = sv[0];
+    pfd.events = POLLPRI;
+    pfd.revents = 0;
+    uint64_t start = RPC::GetMonotonicMS();
+    RPC_ASSERT(poll(&pfd, 1, 50) == 0);
+    uint64_t used = RPC::GetMonotonicMS() - start;
+    RPC_ASSERT(used >= 45 && used < 500);
+    // 没有任何句柄时等同于sleep
+    start = RPC::GetMonotonicMS();
+    RPC_ASSERT(poll(nullptr, 0, 30) == 0);
+    RPC_ASSERT(RPC::GetMonotonicMS() - start >= 25);
+    close_pair(sv);
+    RPC_LOG_INFO(logger) << "test_poll_pri ok";
+}
+
+static void test_select() {
+    int sv[2];
+    make_pair(sv);
+    fd_set rfds;
+    FD_ZERO(&rfds);
+    FD_SET(sv[0], &rfds);
+    timeval tv = {0, 50 * 1000};
+    RPC_ASSERT(select(sv[0] + 1, &rfds, nullptr, nullptr, &tv) == 0);
+    RPC_ASSERT(!FD_ISSET(sv[0], &rfds));
+
+    FD_ZERO(&rfds);
+    FD_SET(sv[0], &rfds);
+    tv = {1, 0};
+    write_later(sv[1], 20);
+    RPC_ASSERT(select(sv[0] + 1, &rfds, nullptr, nullptr, &tv) == 1);
+    RPC_ASSERT(FD_ISSET(sv[0], &rfds));
+    close_pair(sv);
+    RPC_LOG_INFO(logger) << "test_select ok";
+}
+
+static void test_epoll_wait() {
+    int sv[2];
+    make_pair(sv);
+    int epfd = epoll_create1(0);
+    RPC_ASSERT(epfd >= 0);
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = sv[0];
+    RPC_ASSERT(epoll_ctl(epfd, EPOLL_CTL_ADD, sv[0], &ev) == 0);
+    epoll_event events[4];
+    uint64_t start = RPC::GetMonotonicMS();
+    RPC_ASSERT(epoll_wait(epfd, events, 4, 50) == 0);
+    RPC_ASSERT(RPC::GetMonotonicMS() - start >= 45);
+
+    write_later(sv[1], 20);
+    RPC_ASSERT(epoll_wait(epfd, events, 4, 1000) == 1);
+    RPC_ASSERT(events[0].data.fd == sv[0] && (events[0].events & EPOLLIN));
+    close(epfd);
+    close_pair(sv);
+    RPC_LOG_INFO(logger) << "test_epoll_wait ok";
+}
+
+static void test_fd_reuse() {
+    // poll过的管道关闭后, 复用同一句柄号的socket要能重新注册事件
+    int pfds[2];
+    RPC_ASSERT(pipe(pfds) == 0);
+    pollfd pfd;
+    pfd.fd = pfds[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    RPC_ASSERT(poll(&pfd, 1, 20) == 0);
+    close(pfds[0]);
+    close(pfds[1]);
+    int sv[2];
+    make_pair(sv);
+    RPC_ASSERT(sv[0] == pfds[0] || sv[1] == pfds[0]);
+    int fd = sv[0] == pfds[0] ? sv[0] : sv[1];
+    int peer = fd == sv[0] ? sv[1] : sv[0];
+    pfd.fd = fd;
+    write_later(peer, 20);
+    uint64_t start = RPC::GetMonotonicMS();
+    RPC_ASSERT(poll(&pfd, 1, 1000) == 1 && (pfd.revents & POLLIN));
+    RPC_ASSERT(RPC::GetMonotonicMS() - start < 500);
+    char c;
+    RPC_ASSERT(read(fd, &c, 1) == 1);
+    // 阻塞读也能被唤醒
+    write_later(peer, 20);
+    RPC_ASSERT(read(fd, &c, 1) == 1);
+    close_pair(sv);
+    RPC_LOG_INFO(logger) << "test_fd_reuse ok";
+}
+
+static void test_unhooked_close() {
+    // 等待过的socket不经过hook关闭, 句柄号被hook的socket复用时要重新注册
+    int sv[2];
+    make_pair(sv);
+    pollfd pfd;
+    pfd.fd = sv[0];
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    RPC_ASSERT(poll(&pfd, 1, 20) == 0);
+    close_f(sv[0]);
+    close_f(sv[1]);
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    RPC_ASSERT(listen_fd == sv[0]);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    RPC_ASSERT(bind(listen_fd, (sockaddr *)&addr, len) == 0);
+    RPC_ASSERT(listen(listen_fd, 16) == 0);
+    RPC_ASSERT(getsockname(listen_fd, (sockaddr *)&addr, &len) == 0);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    RPC_ASSERT(client >= 0);
+    RPC::IOManager::GetThis()->Submit([client, addr]() {
+        usleep(20 * 1000);
+        RPC_ASSERT(connect(client, (const sockaddr *)&addr, sizeof(addr)) == 0);
+    });
+    pfd.fd = listen_fd;
+    uint64_t start = RPC::GetMonotonicMS();
+    RPC_ASSERT(poll(&pfd, 1, 1000) == 1 && (pfd.revents & POLLIN));
+    RPC_ASSERT(RPC::GetMonotonicMS() - start < 500);
+    int conn = accept(listen_fd, nullptr, nullptr);
+    RPC_ASSERT(conn >= 0);
+    write_later(client, 20);
+    char c;
+    RPC_ASSERT(read(conn, &c, 1) == 1);
+    close(conn);
+    close(client);
+    close(listen_fd);
+    RPC_LOG_INFO(logger) << "test_unhooked_close ok";
+}
+
+static void test_file_io() {
+    char path[] = "/tmp/test_hook_poll_XXXXXX";
+    int fd = mkstemp(path);
+    RPC_ASSERT(fd >= 0);
+    unlink(path);
+    std::string data(64 * 1024, 'a');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (char)('a' + i % 26);
+    }
+    RPC_ASSERT(pwrite(fd, data.data(), data.size(), 100) == (ssize_t)data.size());
+    // 写回并丢弃页缓存, RWF_NOWAIT读不到时交给阻塞线程池(tmpfs上仍然在内存中)
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    std::string buf(data.size(), 0);
+    RPC_ASSERT(pread(fd, &buf[0], buf.size(), 100) == (ssize_t)buf.size());
+    RPC_ASSERT(buf == data);
+    // 读到文件末尾
+    RPC_ASSERT(pread(fd, &buf[0], buf.size(), 100 + data.size()) == 0);
+    close(fd);
+    RPC_ASSERT(pread(fd, &buf[0], 1, 0) == -1 && errno == EBADF);
+    RPC_LOG_INFO(logger) << "test_file_io ok";
+}
+
+static void run_tests(bool reactor_per_thread, bool persistent_event) {
+    RPC::IOManager iom(2, "test_hook_poll", reactor_per_thread, persistent_event);
+    std::atomic<bool> done{false};
+    iom.Submit([&done]() {
+        test_poll();
+        test_poll_duplicate();
+        test_poll_shared();
+        test_poll_pri();
+        test_select();
+        test_epoll_wait();
+        test_fd_reuse();
+        test_unhooked_close();
+        test_file_io();
+        done = true;
+    });
+    while (!done) {
+        usleep(10 * 1000);
+    }
+    RPC_LOG_INFO(logger) << "reactor_per_thread=" << reactor_per_thread
+                         << " persistent_event=" << persistent_event << " all ok";
+}
+
+int main(int argc, char **argv) {
+    // 共享epoll、每线程epoll和常驻注册三种模式下结果相同
+    run_tests(false, false);
+    run_tests(true, false);
+    run_tests(false, true);
+    return 0;
+}
@@ -0,0 +1,245 @@
+/**
+ * @brief Channel和Select
+ *  跨线程收发、关闭唤醒阻塞的收发方、Select被一个channel唤醒却完成另一个时把唤醒转交出去、
+ *  超时和句柄事件
+ */
+#include "io_manager.h"
+#include "fd_manager.h"
+#include "channel.h"
+#include "select.h"
+#include "hook.h"
+#include "log.h"
+#include "macro.h"
+#include "utils.h"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+
+static RPC::Logger::ptr logger = RPC_LOG_ROOT();
+
+/**
+ * @brief 在协程中并发执行funcs, 全部返回后才返回
+ */
+static void run_all(const std::vector<std::function<void()>> &funcs) {
+    std::shared_ptr<std::atomic<size_t>> left(new std::atomic<size_t>(funcs.size()));
+    for (auto &func : funcs) {
+        RPC::IOManager::GetThis()->Submit([func, left]() {
+            func();
+            --*left;
+        });
+    }
+    while (*left) {
+        usleep(1000);
+    }
+}
+
+static void test_channel_threads() {
+    // 4个生产者和4个消费者分布在各个工作线程上, 小容量迫使双方都挂起
+    const int producers = 4;
+    const int count = 20000;
+    RPC::Channel<int> channel(8);
+    std::atomic<long> sum{0};
+    std::atomic<int> received{0};
+    std::vector<std::function<void()>> funcs;
+    for (int p = 0; p < producers; ++p) {
+        funcs.push_back([&channel]() {
+            for (int i = 1; i <= count; ++i) {
+                RPC_ASSERT(channel.push(i));
+            }
+        });
+        funcs.push_back([&]() {
+            int value;
+            while (received.fetch_add(1) < producers * count) {
+                RPC_ASSERT(channel.pop(value));
+                sum += value;
+            }
+        });
+    }
+    run_all(funcs);
+    RPC_ASSERT(sum == (long)producers * count * (count + 1) / 2);
+    RPC_ASSERT(channel.empty());
+    RPC_LOG_INFO(logger) << "test_channel_threads ok";
+}
+
+static void test_channel_close() {
+    // 满的channel上阻塞的发送方和空的channel上阻塞的接收方都被close唤醒, 返回false
+    RPC::Channel<int> full(1);
+    RPC::Channel<int> empty(1);
+    RPC_ASSERT(full.push(0));
+    std::atomic<int> failed{0};
+    std::vector<std::function<void()>> funcs;
+    for (int i = 0; i < 3; ++i) {
+        funcs.push_back([&]() {
+            if (!full.push(1)) {
+                ++failed;
+            }
+        });
+        funcs.push_back([&]() {
+            int value;
+            if (!empty.pop(value)) {
+                ++failed;
+            }
+        });
+    }
+    funcs.push_back([&]() {
+        usleep(20 * 1000);
+        full.close();
+        empty.close();
+    });
+    uint64_t start = RPC::GetMonotonicMS();
+    run_all(funcs);
+    RPC_ASSERT(failed == 6);
+    RPC_ASSERT(RPC::GetMonotonicMS() - start < 500);
+    RPC_ASSERT(!full && !empty);
+    int value;
+    RPC_ASSERT(!full.push(1) && !empty.pop(value));
+    RPC_LOG_INFO(logger) << "test_channel_close ok";
+}
+
+static void test_select_pass_on() {
+    // Select同时等a和b, 另一个协程只等a
+    // 1. Select先挂起, 写入a唤醒它之后马上取走a的值再写入b: Select被a唤醒却完成了b
+    // 2. a和b同时写入: Select登记之后重新检查时可能被a唤醒却先完成了b,
+    //    必须把唤醒转交给a的下一个等待者, 否则a中的值没有人取, 只等a的协程一直挂起
+    int woken_by_a = 0;
+    for (int round = 0; round < 400; ++round) {
+        bool steal = round % 2 == 0;
+        RPC::Channel<int> a(1);
+        RPC::Channel<int> b(1);
+        std::atomic<int> selected{-2};
+        std::atomic<bool> got{false};
+        std::vector<std::function<void()>> funcs;
+        funcs.push_back([&]() {
+            int va = 0;
+            int vb = 0;
+            RPC::Select select;
+            int ia = select.recv(a, va);
+            int ib = select.recv(b, vb);
+            int index = select.wait(1000 * 1000);
+            RPC_ASSERT(index != RPC::Select::TIMEOUT && select.ok());
+            RPC_ASSERT(index == ia ? va == 1 : index == ib && vb == 2);
+            selected = index == ia ? 0 : 1;
+        });
+        funcs.push_back([&]() {
+            if (steal) {
+                // Select先在a上排队, a的唤醒一定先给它
+                while (!b.getPopWaiters().hasWaiters()) {
+                    usleep(100);
+                }
+            }
+            int value;
+            got = a.waitFor(1000, value);
+        });
+        funcs.push_back([&]() {
+            if (steal) {
+                while (!b.getPopWaiters().hasWaiters()) {
+                    usleep(100);
+                }
+                usleep(2000);
+                RPC_ASSERT(a.push(1));
+                int value;
+                bool stolen = a.tryPop(value);
+                RPC_ASSERT(b.push(2));
+                while (selected == -2) {
+                    usleep(1000);
+                }
+                if (stolen) {
+                    RPC_ASSERT(selected == 1);
+                    ++woken_by_a;
+                }
+            } else {
+                RPC_ASSERT(a.push(1));
+                RPC_ASSERT(b.push(2));
+                while (selected == -2) {
+                    usleep(1000);
+                }
+            }
+            if (selected == 0 || steal) {
+                // a的值已被取走, 另写一个值放行只等a的协程
+                RPC_ASSERT(a.push(3));
+            }
+        });
+        uint64_t start = RPC::GetMonotonicMS();
+        run_all(funcs);
+        RPC_ASSERT(got);
+        RPC_ASSERT(RPC::GetMonotonicMS() - start < 500);
+    }
+    RPC_ASSERT(woken_by_a > 0);
+    RPC_LOG_INFO(logger) << "test_select_pass_on ok, woken by a but completed b " << woken_by_a << " times";
+}
+
+static void test_select_timeout() {
+    RPC::Channel<int> channel(1);
+    int value;
+    RPC::Select select;
+    int index = select.recv(channel, value);
+    // 0表示只检查一次不挂起
+    RPC_ASSERT(select.wait(0) == RPC::Select::TIMEOUT);
+    uint64_t start = RPC::GetMonotonicMS();
+    RPC_ASSERT(select.waitFor(30) == RPC::Select::TIMEOUT);
+    RPC_ASSERT(RPC::GetMonotonicMS() - start >= 25);
+    // 超时之后同一个Select仍然可以使用
+    RPC::IOManager::GetThis()->Submit([channel]() mutable {
+        usleep(20 * 1000);
+        channel.push(7);
+    });
+    RPC_ASSERT(select.waitFor(1000) == index && select.ok() && value == 7);
+    // 关闭的channel一直就绪, ok为false
+    channel.close();
+    RPC_ASSERT(select.wait(0) == index && !select.ok());
+    RPC_LOG_INFO(logger) << "test_select_timeout ok";
+}
+
+static void test_select_event() {
+    int sv[2];
+    RPC_ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+    // socketpair没有被hook, 手动创建fd上下文
+    RPC::FdMgr::GetInstance()->getFdContext(sv[0], true);
+    RPC::FdMgr::GetInstance()->getFdContext(sv[1], true);
+    RPC::Channel<int> quit(1);
+    int flag;
+    RPC::Select select;
+    int readable = select.event(sv[0], RPC::IOManager::READ);
+    int stop = select.recv(quit, flag);
+    RPC_ASSERT(select.waitFor(30) == RPC::Select::TIMEOUT);
+    RPC::IOManager::GetThis()->Submit([sv]() {
+        usleep(20 * 1000);
+        RPC_ASSERT(write(sv[1], "x", 1) == 1);
+    });
+    uint64_t start = RPC::GetMonotonicMS();
+    RPC_ASSERT(select.waitFor(1000) == readable && select.ok());
+    RPC_ASSERT(RPC::GetMonotonicMS() - start < 500);
+    char c;
+    RPC_ASSERT(read(sv[0], &c, 1) == 1);
+    // 句柄没有数据时channel先就绪
+    RPC_ASSERT(quit.push(1));
+    RPC_ASSERT(select.waitFor(1000) == stop && select.ok());
+    close(sv[0]);
+    close(sv[1]);
+    RPC_LOG_INFO(logger) << "test_select_event ok";
+}
+
+static void run_tests(bool persistent_event) {
+    RPC::IOManager iom(4, "test_select", false, persistent_event);
+    std::atomic<bool> done{false};
+    iom.Submit([&done]() {
+        test_channel_threads();
+        test_channel_close();
+        test_select_pass_on();
+        test_select_timeout();
+        test_select_event();
+        done = true;
+    });
+    while (!done) {
+        usleep(10 * 1000);
+    }
+    RPC_LOG_INFO(logger) << "persistent_event=" << persistent_event << " all ok";
+}
+
+int main(int argc, char **argv) {
+    run_tests(false);
+    run_tests(true);
+    return 0;
+}